@@ -4,6 +4,10 @@
  * Command line options:
  *    -info      print GL implementation information
  *    -exit      automatically exit after 30 seconds
+ *    -startup   print the startup timeline
+ *    -eager     build the gears before the first frame is shown
+ *
+ * Press g to cycle the performance overlay and memory page.
  *
  *
  * Brian Paul
@@ -14,20 +18,7 @@
  * Adapted for CSCI 4229/5229 by Vlakkies Schreuder
  */
 
-#include <math.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <stdio.h>
-#include <string.h>
-#ifdef USEGLEW
-#include <GL/glew.h>
-#endif
-#define GL_GLEXT_PROTOTYPES
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-#else
-#include <GL/glut.h>
-#endif
+#include "../lighting/CSCIx229.h"
 //  Default resolution
 //  For Retina displays compile with -DRES=2
 #ifndef RES
@@ -180,6 +171,23 @@ static GLfloat view_rotx = 0.0, view_roty = 0.0, view_rotz = 0.0;
 static GLint gear1, gear2, gear3;
 static GLfloat angle = 0.0;
 
+/* build a gear display list (0 if it has to wait for a later frame) */
+static GLint
+makegear(const GLfloat color[4], GLfloat inner_radius, GLfloat outer_radius,
+  GLfloat width, GLint teeth, GLfloat tooth_depth)
+{
+  GLint list;
+
+  if (!Lazy())
+    return 0;
+  list = glGenLists(1);
+  glNewList(list, GL_COMPILE);
+  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, color);
+  gear(inner_radius, outer_radius, width, teeth, tooth_depth);
+  glEndList();
+  return list;
+}
+
 static void
 cleanup(void)
 {
@@ -190,25 +198,21 @@ cleanup(void)
 }
 
 
-#define LEN 8192  //  Maximum length of text string
-static void
-Print(const char* format , ...)
-{
-   char    buf[LEN];
-   char*   ch=buf;
-   va_list args;
-   //  Turn the parameters into a character string
-   va_start(args,format);
-   vsnprintf(buf,LEN,format,args);
-   va_end(args);
-   //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
-}
-
 static void
 draw(void)
 {
+  static const GLfloat red[4] = {0.8, 0.1, 0.0, 1.0};
+  static const GLfloat green[4] = {0.0, 0.8, 0.2, 1.0};
+  static const GLfloat blue[4] = {0.2, 0.2, 1.0, 1.0};
+
+  TraceScope("draw");
+  /* make the gears once the window is up */
+  if (!gear1)
+    gear1 = makegear(red, 1.0, 4.0, 1.0, 20, 0.7);
+  if (!gear2)
+    gear2 = makegear(green, 0.5, 2.0, 2.0, 10, 0.7);
+  if (!gear3)
+    gear3 = makegear(blue, 1.3, 2.0, 0.5, 10, 0.7);
   // clears the frame buffer and the depth buffer
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -221,19 +225,25 @@ draw(void)
     glPushMatrix();
       glTranslatef(-3.0, -2.0, 0.0);
       glRotatef(angle, 0.0, 0.0, 1.0);
+      GpuBegin("gear1");
       glCallList(gear1);
+      GpuEnd();
     glPopMatrix();
 
     glPushMatrix();
       glTranslatef(3.1, -2.0, 0.0);
       glRotatef(-2.0 * angle - 9.0, 0.0, 0.0, 1.0);
+      GpuBegin("gear2");
       glCallList(gear2);
+      GpuEnd();
     glPopMatrix();
 
     glPushMatrix();
       glTranslatef(-3.1, 4.2, 0.0);
       glRotatef(-2.0 * angle - 25.0, 0.0, 0.0, 1.0);
+      GpuBegin("gear3");
       glCallList(gear3);
+      GpuEnd();
     glPopMatrix();
 
   glPopMatrix();
@@ -259,8 +269,14 @@ draw(void)
   glColor3f(1,1,1);
   glWindowPos2i(5,5);
   Print("FPS %.3f", fps);
+  //  Performance overlay with GPU time per gear
+  GpuFrame();
+  PerfHud(0,5,25);
+  HudDraw();
 
   glutSwapBuffers();
+  TraceFrame();
+  StartupFrame();
 }
 
 
@@ -292,6 +308,9 @@ key(unsigned char k, int x, int y)
   case 'Z':
     view_rotz -= 5.0;
     break;
+  case 'g':
+    PerfToggle();
+    break;
   case 27:  /* Escape */
     cleanup();
     exit(0);
@@ -345,9 +364,6 @@ static void
 init(int argc, char *argv[])
 {
   static GLfloat pos[4] = {5.0, 5.0, 10.0, 0.0};
-  static GLfloat red[4] = {0.8, 0.1, 0.0, 1.0};
-  static GLfloat green[4] = {0.0, 0.8, 0.2, 1.0};
-  static GLfloat blue[4] = {0.2, 0.2, 1.0, 1.0};
   GLint i;
 
   glLightfv(GL_LIGHT0, GL_POSITION, pos);
@@ -356,25 +372,6 @@ init(int argc, char *argv[])
   glEnable(GL_LIGHT0);
   glEnable(GL_DEPTH_TEST);
 
-  /* make the gears */
-  gear1 = glGenLists(1);
-  glNewList(gear1, GL_COMPILE);
-  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, red);
-  gear(1.0, 4.0, 1.0, 20, 0.7);
-  glEndList();
-
-  gear2 = glGenLists(1);
-  glNewList(gear2, GL_COMPILE);
-  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, green);
-  gear(0.5, 2.0, 2.0, 10, 0.7);
-  glEndList();
-
-  gear3 = glGenLists(1);
-  glNewList(gear3, GL_COMPILE);
-  glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, blue);
-  gear(1.3, 2.0, 0.5, 10, 0.7);
-  glEndList();
-
   glEnable(GL_NORMALIZE);
 
   for ( i=1; i<argc; i++ ) {
@@ -402,20 +399,26 @@ visible(int vis)
 
 int main(int argc, char *argv[])
 {
+  StartupInit(argc, argv);
   glutInit(&argc, argv);
+  StartupMark("glutInit");
   glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
 
   glutInitWindowPosition(0, 0);
   glutInitWindowSize(300, 300);
   win = glutCreateWindow("Gears");
+  StartupMark("window");
 #ifdef USEGLEW
    if (glewInit()!=GLEW_OK)
    {
       fprintf(stderr,"Error initializing GLEW\n");
       exit(1);
    }
+   StartupMark("glew");
 #endif
+  GpuInit(argc, argv);
   init(argc, argv);
+  StartupMark("init");
 
   glutDisplayFunc(draw);
   glutReshapeFunc(reshape);
@@ -46,6 +46,69 @@
 extern "C" {
 #endif
 
+//  Tiled texture (see tiledtex.c)
+typedef struct tiled_s tiled_t;
+
+//  4x4 column major matrix and transform stack (see mat4.c)
+//  Columns are GCC vectors of four floats where available and plain
+//  structs otherwise, so read elements with V4(v,i) and do arithmetic
+//  with Vec4fAdd, Vec4fSub and Vec4fScale
+#ifdef __GNUC__
+typedef float Vec4f __attribute__ ((vector_size(16)));
+#define V4(v,i) (v)[i]
+#define Vec4fAdd(a,b)   ((a)+(b))
+#define Vec4fSub(a,b)   ((a)-(b))
+#define Vec4fScale(a,s) ((a)*(s))
+#else
+typedef struct {float v[4];} Vec4f;
+#define V4(a,i) (a).v[i]
+Vec4f Vec4fAdd(Vec4f a,Vec4f b);
+Vec4f Vec4fSub(Vec4f a,Vec4f b);
+Vec4f Vec4fScale(Vec4f a,float s);
+#endif
+typedef struct {Vec4f c[4];} Mat4;
+#define MAT4DEPTH 32
+typedef struct {int n; Mat4 m[MAT4DEPTH];} mat4stack_t;
+
+//  View frustum as six inward facing planes (see frustum.c)
+typedef struct {Vec4f p[6];} frustum_t;
+
+//  Check for OpenGL errors (see errcheck.c)
+//  With NDEBUG only when --gl-debug is given
+#ifdef NDEBUG
+extern int ErrCheckOn;
+#define ErrCheck(where) (ErrCheckOn ? ErrCheckAt(where,__FILE__,__LINE__) : (void)0)
+#else
+#define ErrCheck(where) ErrCheckAt(where,__FILE__,__LINE__)
+#endif
+
+//  CPU trace scopes, compiled in with -DTRACE (see trace.c)
+#ifdef TRACE
+typedef struct {const char* name; long long t0;} tracescope_t;
+#define TRACEVAR2(line) tracescope_##line
+#define TRACEVAR(line) TRACEVAR2(line)
+#define TraceScope(name) tracescope_t TRACEVAR(__LINE__) __attribute__ ((cleanup(TraceEnd))) = TraceBegin(name)
+#else
+#define TraceScope(name)
+#define TraceFrame()
+#define TraceInit(argc,argv)
+#endif
+
+//  Noise types (see noise.c)
+#define NOISE_PERLIN  0
+#define NOISE_SIMPLEX 1
+#define NOISE_WORLEY  2
+
+//  Memory categories and GL object types (see memacct.c)
+#define MEM_MESH    0
+#define MEM_TEXTURE 1
+#define MEM_TEXT    2
+#define MEM_TEMP    3
+#define MEM_ALL     4
+#define MEM_TEXOBJ  0
+#define MEM_BUFOBJ  1
+#define MEM_LISTOBJ 2
+
 #ifdef __GNUC__
 void Print(const char* format , ...) __attribute__ ((format(printf,1,2)));
 void Fatal(const char* format , ...) __attribute__ ((format(printf,1,2))) __attribute__ ((noreturn));
@@ -53,11 +116,272 @@ void Fatal(const char* format , ...) __attribute__ ((format(printf,1,2))) __attr
 void Print(const char* format , ...);
 void Fatal(const char* format , ...);
 #endif
+void PrintFlush(void);
+#define HUDLINES 32  //  HUD lines are numbered 0 to HUDLINES-1 (see hud.c)
+#ifdef __GNUC__
+void HudLine(int k,int x,int y,const char* format , ...) __attribute__ ((format(printf,4,5)));
+#else
+void HudLine(int k,int x,int y,const char* format , ...);
+#endif
+void HudQuads(int k,int n,const float v[][6]);
+void HudDraw(void);
+double HudTime(void);
 unsigned int LoadTexBMP(const char* file);
+void LoadTexBMPs(int n,const char* file[],unsigned int tex[]);
+void TexCache(int mode);
+void TexCompress(int mode);
+void TexQuality(int q);
+unsigned char* CompressBC(const unsigned char* image,int dx,int dy,int ncomp,unsigned int* size);
+unsigned char* HalveImage(const unsigned char* image,int dx,int dy,int ncomp,int* DX,int* DY);
+void TexReload(unsigned int texture,const char* file,int drop);
+int  MipSize(int size,int l);
+unsigned int TexUpload(unsigned int texture,unsigned int format,int dx,int dy,int levels,unsigned char* data[],const unsigned int size[]);
+unsigned int TexCacheLoad(const char* file,int compressed,unsigned int texture,int drop);
+void TexCacheSave(const char* file,unsigned int format,int dx,int dy,int levels,unsigned char* data[],const unsigned int size[]);
+int  BMPLayout(const char* file,int* dx,int* dy,int* ncomp,long* offset,int* stride,int* topdown);
+tiled_t* LoadTiledBMP(const char* file);
+void DrawTiled(tiled_t* t,double x0,double z0,double x1,double z1,double y);
+void FreeTiled(tiled_t* t);
+void TexManage(unsigned int texture,const char* file);
+void TexTouch(unsigned int texture);
+void TexBind(unsigned int texture);
+void TexList(unsigned int list,int n,const unsigned int texture[]);
+void TexCallList(unsigned int list);
+void TexBudget(size_t bytes);
+void TexMemory(size_t* resident,size_t* budget);
+void TexFrame(void);
+unsigned int NoiseTexture(int type,unsigned int seed,int size,int freq,int octaves);
+unsigned int NoiseTextureLazy(int type,unsigned int seed,int size,int freq,int octaves);
+int  NumCPU(void);
+void Parallel(int n,void (*func)(int,void*),void* arg);
 void Project(double fov,double asp,double dim);
-void ErrCheck(const char* where);
+float ProjectedRadius(Mat4 m,float r);
+unsigned int CreateShaderProg(const char* vert,const char* frag,const char* attrib[]);
+void MaterialSet(unsigned int face,unsigned int pname,const float* v);
+void MaterialSetf(unsigned int face,unsigned int pname,float v);
+void MaterialInvalidate(void);
+void MaterialFrame(void);
+void MaterialStats(int* made,int* skipped);
+Mat4 Mat4Identity(void);
+Vec4f Mat4Vec(Mat4 m,Vec4f v);
+Mat4 Mat4Mul(Mat4 a,Mat4 b);
+void Mat4MulN(Mat4 a,const Mat4* b,Mat4* out,int n);
+Mat4 Mat4Translate(Mat4 m,float x,float y,float z);
+Mat4 Mat4Rotate(Mat4 m,float th,float x,float y,float z);
+Mat4 Mat4Scale(Mat4 m,float x,float y,float z);
+Mat4 Mat4Perspective(float fov,float asp,float zn,float zf);
+Mat4 Mat4Ortho(float l,float r,float b,float t,float n,float f);
+Mat4 Mat4LookAt(float ex,float ey,float ez , float cx,float cy,float cz , float ux,float uy,float uz);
+void Mat4Store(Mat4 m,float out[16]);
+void Mat4Load(Mat4 m);
+Mat4 Mat4Get(unsigned int which);
+void StackInit(mat4stack_t* s);
+void StackPush(mat4stack_t* s);
+void StackPop(mat4stack_t* s);
+void StackLoad(mat4stack_t* s,Mat4 m);
+void StackMul(mat4stack_t* s,Mat4 m);
+void StackTranslate(mat4stack_t* s,float x,float y,float z);
+void StackRotate(mat4stack_t* s,float th,float x,float y,float z);
+void StackScale(mat4stack_t* s,float x,float y,float z);
+Mat4 StackTop(const mat4stack_t* s);
+void PathInt(int* v);
+void PathDouble(double* v);
+void PathArgs(int argc,char* argv[],void (*key)(unsigned char,int,int),void (*special)(int,int,int));
+void PathKey(int special,int key);
+double PathTime(void);
+void PathFrame(void);
+#ifdef TRACE
+void TraceInit(int argc,char* argv[]);
+tracescope_t TraceBegin(const char* name);
+void TraceEnd(tracescope_t* s);
+void TraceFrame(void);
+void TraceDump(const char* file,int frames);
+int  TraceStat(int k,const char** name,double* ms);
+#endif
+void GpuInit(int argc,char* argv[]);
+void GpuBegin(const char* name);
+void GpuEnd(void);
+void GpuFrame(void);
+void GpuHud(int k,int x,int y);
+void PerfToggle(void);
+void PerfHud(int k,int x,int y);
+void* MemAlloc(int cat,size_t n);
+void* MemCalloc(int cat,size_t n,size_t size);
+void* MemRealloc(int cat,void* p,size_t n);
+void  MemFree(void* p);
+void  MemGL(int type,unsigned int name,int cat,size_t bytes);
+void  MemQuery(int cat,size_t* cpulive,size_t* cpumax,size_t* gpulive,size_t* gpumax);
+void  MemHud(int k,int x,int y);
+void StartupInit(int argc,char* argv[]);
+void StartupMark(const char* name);
+void StartupFrame(void);
+int  Lazy(void);
+frustum_t Frustum(Mat4 m);
+frustum_t FrustumGL(void);
+int  SphereVisible(const frustum_t* f,float x,float y,float z,float r);
+int  BoxVisible(const frustum_t* f,float x0,float y0,float z0,float x1,float y1,float z1);
+void SpheresVisible(const frustum_t* f,int n,const float x[],const float y[],const float z[],const float r[],unsigned char vis[]);
+void BoxesVisible(const frustum_t* f,int n,const float x0[],const float y0[],const float z0[],
+                                           const float x1[],const float y1[],const float z1[],unsigned char vis[]);
+void ErrCheckInit(int argc,char* argv[]);
+void ErrCheckAt(const char* where,const char* file,int line);
 int  LoadOBJ(const char* file);
 
+//  OpenGL call counting, compiled in with -DGLSTATS (see glstats.c)
+//  Each counted entry point becomes a macro that bumps its counter and
+//  then calls the real function (a macro does not expand inside itself)
+//  Otherwise only draws reported with GlDrawCount are counted
+#ifdef GLSTATS
+#define GLSTAT_VERTEX 0  //  Vertices
+#define GLSTAT_ATTRIB 1  //  Per vertex attributes
+#define GLSTAT_DRAW   2  //  Primitives and draw calls
+#define GLSTAT_STATE  3  //  State changes
+#define GLSTAT_MATRIX 4  //  Matrix operations
+#define GLSTAT_OTHER  5  //  Everything else
+#define GLSTAT_LIST(X) \
+   X(glVertex2f,GLSTAT_VERTEX) X(glVertex2d,GLSTAT_VERTEX) X(glVertex2i,GLSTAT_VERTEX) X(glVertex3f,GLSTAT_VERTEX) \
+   X(glVertex3d,GLSTAT_VERTEX) X(glVertex3fv,GLSTAT_VERTEX) X(glVertex3dv,GLSTAT_VERTEX) X(glVertex4f,GLSTAT_VERTEX) \
+   X(glNormal3f,GLSTAT_ATTRIB) X(glNormal3d,GLSTAT_ATTRIB) X(glNormal3fv,GLSTAT_ATTRIB) X(glNormal3dv,GLSTAT_ATTRIB) \
+   X(glColor3f,GLSTAT_ATTRIB) X(glColor3d,GLSTAT_ATTRIB) X(glColor3fv,GLSTAT_ATTRIB) X(glColor3ub,GLSTAT_ATTRIB) \
+   X(glColor4f,GLSTAT_ATTRIB) X(glColor4fv,GLSTAT_ATTRIB) X(glTexCoord2f,GLSTAT_ATTRIB) X(glTexCoord2d,GLSTAT_ATTRIB) \
+   X(glTexCoord2fv,GLSTAT_ATTRIB) \
+   X(glBegin,GLSTAT_DRAW) X(glDrawArrays,GLSTAT_DRAW) X(glDrawElements,GLSTAT_DRAW) X(glDrawElementsInstanced,GLSTAT_DRAW) \
+   X(glEnable,GLSTAT_STATE) X(glDisable,GLSTAT_STATE) X(glBindTexture,GLSTAT_STATE) X(glMaterialf,GLSTAT_STATE) \
+   X(glMaterialfv,GLSTAT_STATE) X(glMateriali,GLSTAT_STATE) X(glLightf,GLSTAT_STATE) X(glLightfv,GLSTAT_STATE) \
+   X(glLightModeli,GLSTAT_STATE) X(glColorMaterial,GLSTAT_STATE) X(glShadeModel,GLSTAT_STATE) X(glTexEnvi,GLSTAT_STATE) \
+   X(glTexParameteri,GLSTAT_STATE) X(glTexGeni,GLSTAT_STATE) X(glTexGenfv,GLSTAT_STATE) X(glPolygonMode,GLSTAT_STATE) \
+   X(glAlphaFunc,GLSTAT_STATE) X(glDepthFunc,GLSTAT_STATE) X(glBlendFunc,GLSTAT_STATE) X(glPushAttrib,GLSTAT_STATE) \
+   X(glPopAttrib,GLSTAT_STATE) X(glLineWidth,GLSTAT_STATE) X(glPointSize,GLSTAT_STATE) \
+   X(glMatrixMode,GLSTAT_MATRIX) X(glPushMatrix,GLSTAT_MATRIX) X(glPopMatrix,GLSTAT_MATRIX) X(glLoadIdentity,GLSTAT_MATRIX) \
+   X(glLoadMatrixf,GLSTAT_MATRIX) X(glMultMatrixf,GLSTAT_MATRIX) X(glMultMatrixd,GLSTAT_MATRIX) X(glTranslatef,GLSTAT_MATRIX) \
+   X(glTranslated,GLSTAT_MATRIX) X(glRotatef,GLSTAT_MATRIX) X(glRotated,GLSTAT_MATRIX) X(glScalef,GLSTAT_MATRIX) \
+   X(glScaled,GLSTAT_MATRIX) X(glOrtho,GLSTAT_MATRIX) X(glFrustum,GLSTAT_MATRIX) \
+   X(glEnd,GLSTAT_OTHER) X(glCallList,GLSTAT_OTHER) X(glNewList,GLSTAT_OTHER) X(glEndList,GLSTAT_OTHER) \
+   X(glRasterPos3d,GLSTAT_OTHER) X(glClear,GLSTAT_OTHER)
+#define X(fn,cat) GLSTAT_##fn,
+enum {GLSTAT_LIST(X) GLSTAT_N};
+#undef X
+void GlStatInit(int argc,char* argv[]);
+void GlStatCount(int id);
+void GlStatVertices(int id,unsigned int mode,int n);
+void GlStatBegin(unsigned int mode);
+void GlStatEnd(void);
+void GlStatNewList(unsigned int list,unsigned int mode);
+void GlStatCallList(unsigned int list);
+void GlStatFrame(void);
+void GlStatHud(int k,int x,int y);
+#define GLSTAT(fn,...) (GlStatCount(GLSTAT_##fn),fn(__VA_ARGS__))
+#define glVertex2f(...) GLSTAT(glVertex2f,__VA_ARGS__)
+#define glVertex2d(...) GLSTAT(glVertex2d,__VA_ARGS__)
+#define glVertex2i(...) GLSTAT(glVertex2i,__VA_ARGS__)
+#define glVertex3f(...) GLSTAT(glVertex3f,__VA_ARGS__)
+#define glVertex3d(...) GLSTAT(glVertex3d,__VA_ARGS__)
+#define glVertex3fv(...) GLSTAT(glVertex3fv,__VA_ARGS__)
+#define glVertex3dv(...) GLSTAT(glVertex3dv,__VA_ARGS__)
+#define glVertex4f(...) GLSTAT(glVertex4f,__VA_ARGS__)
+#define glNormal3f(...) GLSTAT(glNormal3f,__VA_ARGS__)
+#define glNormal3d(...) GLSTAT(glNormal3d,__VA_ARGS__)
+#define glNormal3fv(...) GLSTAT(glNormal3fv,__VA_ARGS__)
+#define glNormal3dv(...) GLSTAT(glNormal3dv,__VA_ARGS__)
+#define glColor3f(...) GLSTAT(glColor3f,__VA_ARGS__)
+#define glColor3d(...) GLSTAT(glColor3d,__VA_ARGS__)
+#define glColor3fv(...) GLSTAT(glColor3fv,__VA_ARGS__)
+#define glColor3ub(...) GLSTAT(glColor3ub,__VA_ARGS__)
+#define glColor4f(...) GLSTAT(glColor4f,__VA_ARGS__)
+#define glColor4fv(...) GLSTAT(glColor4fv,__VA_ARGS__)
+#define glTexCoord2f(...) GLSTAT(glTexCoord2f,__VA_ARGS__)
+#define glTexCoord2d(...) GLSTAT(glTexCoord2d,__VA_ARGS__)
+#define glTexCoord2fv(...) GLSTAT(glTexCoord2fv,__VA_ARGS__)
+//  Calls that count their arguments go through functions so each argument is evaluated once
+static inline void GlStatBeginCall(GLenum mode)
+{
+   GlStatBegin(mode);
+   glBegin(mode);
+}
+static inline void GlStatDrawArrays(GLenum mode,GLint first,GLsizei count)
+{
+   GlStatVertices(GLSTAT_glDrawArrays,mode,count);
+   glDrawArrays(mode,first,count);
+}
+static inline void GlStatDrawElements(GLenum mode,GLsizei count,GLenum type,const void* index)
+{
+   GlStatVertices(GLSTAT_glDrawElements,mode,count);
+   glDrawElements(mode,count,type,index);
+}
+#define glBegin GlStatBeginCall
+#define glDrawArrays GlStatDrawArrays
+#define glDrawElements GlStatDrawElements
+#ifdef GL_VERSION_3_1
+static inline void GlStatDrawElementsInstanced(GLenum mode,GLsizei count,GLenum type,const void* index,GLsizei n)
+{
+   GlStatVertices(GLSTAT_glDrawElementsInstanced,mode,count*n);
+   glDrawElementsInstanced(mode,count,type,index,n);
+}
+#define glDrawElementsInstanced GlStatDrawElementsInstanced
+#endif
+#define glEnable(...) GLSTAT(glEnable,__VA_ARGS__)
+#define glDisable(...) GLSTAT(glDisable,__VA_ARGS__)
+#define glBindTexture(...) GLSTAT(glBindTexture,__VA_ARGS__)
+#define glMaterialf(...) GLSTAT(glMaterialf,__VA_ARGS__)
+#define glMaterialfv(...) GLSTAT(glMaterialfv,__VA_ARGS__)
+#define glMateriali(...) GLSTAT(glMateriali,__VA_ARGS__)
+#define glLightf(...) GLSTAT(glLightf,__VA_ARGS__)
+#define glLightfv(...) GLSTAT(glLightfv,__VA_ARGS__)
+#define glLightModeli(...) GLSTAT(glLightModeli,__VA_ARGS__)
+#define glColorMaterial(...) GLSTAT(glColorMaterial,__VA_ARGS__)
+#define glShadeModel(...) GLSTAT(glShadeModel,__VA_ARGS__)
+#define glTexEnvi(...) GLSTAT(glTexEnvi,__VA_ARGS__)
+#define glTexParameteri(...) GLSTAT(glTexParameteri,__VA_ARGS__)
+#define glTexGeni(...) GLSTAT(glTexGeni,__VA_ARGS__)
+#define glTexGenfv(...) GLSTAT(glTexGenfv,__VA_ARGS__)
+#define glPolygonMode(...) GLSTAT(glPolygonMode,__VA_ARGS__)
+#define glAlphaFunc(...) GLSTAT(glAlphaFunc,__VA_ARGS__)
+#define glDepthFunc(...) GLSTAT(glDepthFunc,__VA_ARGS__)
+#define glBlendFunc(...) GLSTAT(glBlendFunc,__VA_ARGS__)
+#define glPushAttrib(...) GLSTAT(glPushAttrib,__VA_ARGS__)
+#define glPopAttrib(...) GLSTAT(glPopAttrib,__VA_ARGS__)
+#define glLineWidth(...) GLSTAT(glLineWidth,__VA_ARGS__)
+#define glPointSize(...) GLSTAT(glPointSize,__VA_ARGS__)
+#define glMatrixMode(...) GLSTAT(glMatrixMode,__VA_ARGS__)
+#define glPushMatrix(...) GLSTAT(glPushMatrix,__VA_ARGS__)
+#define glPopMatrix(...) GLSTAT(glPopMatrix,__VA_ARGS__)
+#define glLoadIdentity(...) GLSTAT(glLoadIdentity,__VA_ARGS__)
+#define glLoadMatrixf(...) GLSTAT(glLoadMatrixf,__VA_ARGS__)
+#define glMultMatrixf(...) GLSTAT(glMultMatrixf,__VA_ARGS__)
+#define glMultMatrixd(...) GLSTAT(glMultMatrixd,__VA_ARGS__)
+#define glTranslatef(...) GLSTAT(glTranslatef,__VA_ARGS__)
+#define glTranslated(...) GLSTAT(glTranslated,__VA_ARGS__)
+#define glRotatef(...) GLSTAT(glRotatef,__VA_ARGS__)
+#define glRotated(...) GLSTAT(glRotated,__VA_ARGS__)
+#define glScalef(...) GLSTAT(glScalef,__VA_ARGS__)
+#define glScaled(...) GLSTAT(glScaled,__VA_ARGS__)
+#define glOrtho(...) GLSTAT(glOrtho,__VA_ARGS__)
+#define glFrustum(...) GLSTAT(glFrustum,__VA_ARGS__)
+#define glEnd() (GlStatEnd(),glEnd())
+static inline void GlStatCallListCall(GLuint list)
+{
+   GlStatCallList(list);
+   glCallList(list);
+}
+static inline void GlStatNewListCall(GLuint list,GLenum mode)
+{
+   GlStatNewList(list,mode);
+   glNewList(list,mode);
+}
+#define glCallList GlStatCallListCall
+#define glNewList GlStatNewListCall
+#define glEndList() (GlStatNewList(0,0),glEndList())
+#define glRasterPos3d(...) GLSTAT(glRasterPos3d,__VA_ARGS__)
+#define glClear(...) GLSTAT(glClear,__VA_ARGS__)
+#define GlDrawCount(mode,n)
+#else
+#define GlStatInit(argc,argv)
+#define GlStatFrame()
+#define GlStatHud(k,x,y)
+void GlDrawCount(unsigned int mode,int n);
+void GlDrawFrame(unsigned int* draws,unsigned int* triangles);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,348 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+//  Camera path recording and playback
+//
+//  With -record FILE every key press is written to FILE with the time it
+//  happened and the camera variables registered by PathInt/PathDouble.
+//  With -play FILE the keys are fed back to the program's handlers on a
+//  fixed simulated timestep (-dt, 1/60s by default) regardless of how long
+//  frames really take, so animation and camera follow exactly the same path
+//  in every build.  The wall clock time of each frame is written as CSV to
+//  stdout or to -csv FILE.  A summary goes to stderr when the path ends so
+//  it never mixes with the CSV rows.
+//
+//  File format (native byte order)
+//    "CAMP"  int nvar
+//    float time  short type  short key  double var[nvar]   (repeated)
+//
+
+#define MAXVAR 16
+#define MAGIC "CAMP"
+
+//  Record types
+#define EV_STATE   0  //  Camera state only
+#define EV_KEY     1  //  Keyboard key
+#define EV_SPECIAL 2  //  Special key
+#define EV_END     3  //  End of path
+
+//  Path record
+typedef struct
+{
+   float t;           //  Time (seconds)
+   short type;        //  Record type
+   short key;         //  Key code
+   double var[MAXVAR];//  Camera variables
+} event_t;
+
+//  Registered camera variables
+static int     nvar=0;
+static int*    ivar[MAXVAR];
+static double* dvar[MAXVAR];
+
+//  Recording
+static FILE*  rec=NULL;   //  Path being recorded
+static double t0=-1;      //  Clock at start
+
+//  Playback
+static event_t* ev=NULL;  //  Path being played
+static int      nev=0;    //  Number of records
+static int      next=0;   //  Next record
+static double   dt=1/60.0;//  Simulated timestep
+static int      frame=-1; //  Frame number (-1=not playing)
+static double   last;     //  Clock at the end of the previous frame
+static float*   ms=NULL;  //  Frame times
+static FILE*    csv=NULL; //  Frame time output
+static int      warn=0;   //  Path diverged
+static void   (*keyfunc)(unsigned char,int,int);
+static void   (*specfunc)(int,int,int);
+
+//
+//  Wall clock in seconds
+//
+static double Now(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER f,c;
+   QueryPerformanceFrequency(&f);
+   QueryPerformanceCounter(&c);
+   return (double)c.QuadPart/f.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
+
+//
+//  Register camera variables
+//
+static void Register(int* i,double* d)
+{
+   if (nvar>=MAXVAR) Fatal("Too many camera path variables\n");
+   ivar[nvar] = i;
+   dvar[nvar] = d;
+   nvar++;
+}
+
+void PathInt(int* v)
+{
+   Register(v,NULL);
+}
+
+void PathDouble(double* v)
+{
+   Register(NULL,v);
+}
+
+//
+//  Copy camera variables to and from a record
+//
+static void GetState(event_t* e)
+{
+   for (int k=0;k<nvar;k++)
+      e->var[k] = ivar[k] ? *ivar[k] : *dvar[k];
+}
+
+static int SetState(const event_t* e)
+{
+   int changed=0;
+   for (int k=0;k<nvar;k++)
+   {
+      if (ivar[k])
+      {
+         changed |= *ivar[k]!=(int)e->var[k];
+         *ivar[k] = (int)e->var[k];
+      }
+      else
+      {
+         changed |= *dvar[k]!=e->var[k];
+         *dvar[k] = e->var[k];
+      }
+   }
+   return changed;
+}
+
+//
+//  Write a record
+//
+static void Write(int type,int key)
+{
+   event_t e;
+   e.t = Now()-t0;
+   e.type = type;
+   e.key = key;
+   GetState(&e);
+   if (fwrite(&e.t,sizeof(e.t),1,rec)!=1 ||
+       fwrite(&e.type,sizeof(e.type),1,rec)!=1 ||
+       fwrite(&e.key,sizeof(e.key),1,rec)!=1 ||
+       fwrite(e.var,sizeof(double),nvar,rec)!=nvar)
+      Fatal("Error writing camera path\n");
+}
+
+//
+//  Finish recording at exit
+//
+static void EndRecord(void)
+{
+   Write(EV_END,0);
+   fclose(rec);
+   rec = NULL;
+}
+
+//
+//  Start recording to file
+//
+static void PathRecord(const char* file)
+{
+   rec = fopen(file,"wb");
+   if (!rec) Fatal("Cannot open camera path %s\n",file);
+   if (fwrite(MAGIC,4,1,rec)!=1 || fwrite(&nvar,sizeof(nvar),1,rec)!=1)
+      Fatal("Error writing camera path %s\n",file);
+   t0 = Now();
+   Write(EV_STATE,0);
+   atexit(EndRecord);
+}
+
+//
+//  Record a key press (call at the end of the key and special handlers)
+//
+void PathKey(int special,int key)
+{
+   if (rec) Write(special ? EV_SPECIAL : EV_KEY,key);
+}
+
+//
+//  Only ESC works during playback
+//
+static void PlayKey(unsigned char ch,int x,int y)
+{
+   if (ch==27) exit(0);
+}
+
+//
+//  Load path and start playback
+//
+static void PathPlay(const char* file)
+{
+   FILE* f = fopen(file,"rb");
+   if (!f) Fatal("Cannot open camera path %s\n",file);
+   char magic[4];
+   int n;
+   if (fread(magic,4,1,f)!=1 || memcmp(magic,MAGIC,4) || fread(&n,sizeof(n),1,f)!=1)
+      Fatal("%s is not a camera path\n",file);
+   if (n!=nvar) Fatal("Camera path %s has %d variables, expected %d\n",file,n,nvar);
+   //  Read records up to the end marker
+   int m=0;
+   for (;;)
+   {
+      if (nev>=m)
+      {
+         m = 2*m+64;
+         ev = (event_t*)realloc(ev,m*sizeof(event_t));
+         if (!ev) Fatal("Cannot allocate memory for camera path\n");
+      }
+      event_t* e = ev+nev;
+      if (fread(&e->t,sizeof(e->t),1,f)!=1 ||
+          fread(&e->type,sizeof(e->type),1,f)!=1 ||
+          fread(&e->key,sizeof(e->key),1,f)!=1 ||
+          fread(e->var,sizeof(double),nvar,f)!=nvar)
+         Fatal("Camera path %s is truncated\n",file);
+      nev++;
+      if (e->type==EV_END) break;
+   }
+   fclose(f);
+   //  Start from the recorded state
+   SetState(ev);
+   next = 1;
+   frame = 0;
+   ms = (float*)malloc((int)(ev[nev-1].t/dt+2)*sizeof(float));
+   if (!ms) Fatal("Cannot allocate memory for frame times\n");
+   //  Keep the user from steering
+   glutKeyboardFunc(PlayKey);
+   glutSpecialFunc(NULL);
+}
+
+//
+//  Parse camera path options
+//    -record FILE  record key presses to FILE
+//    -play FILE    play back FILE
+//    -dt SEC       simulated time per frame during playback
+//    -csv FILE     write frame times to FILE instead of stdout
+//  Call after the callbacks are set and the camera variables are registered
+//
+void PathArgs(int argc,char* argv[],void (*key)(unsigned char,int,int),void (*special)(int,int,int))
+{
+   const char* play=NULL;
+   keyfunc = key;
+   specfunc = special;
+   for (int k=1;k<argc;k++)
+   {
+      if (k+1>=argc)
+         break;
+      else if (!strcmp(argv[k],"-record"))
+         PathRecord(argv[++k]);
+      else if (!strcmp(argv[k],"-play"))
+         play = argv[++k];
+      else if (!strcmp(argv[k],"-dt"))
+      {
+         dt = atof(argv[++k]);
+         if (dt<=0) Fatal("Invalid timestep %s\n",argv[k]);
+      }
+      else if (!strcmp(argv[k],"-csv"))
+      {
+         csv = fopen(argv[++k],"w");
+         if (!csv) Fatal("Cannot open %s\n",argv[k]);
+      }
+   }
+   if (play && rec) Fatal("Cannot record and play a camera path at the same time\n");
+   if (play) PathPlay(play);
+}
+
+//
+//  Animation time in seconds
+//  Simulated time during playback, wall clock time otherwise
+//
+double PathTime(void)
+{
+   if (frame>=0) return frame*dt;
+   if (t0<0) t0 = Now();
+   return Now()-t0;
+}
+
+//
+//  Compare floats for qsort
+//
+static int CompareFloat(const void* a,const void* b)
+{
+   float x = *(const float*)a;
+   float y = *(const float*)b;
+   return (x>y) - (x<y);
+}
+
+//
+//  Print summary and quit
+//
+static void EndPlay(void)
+{
+   FILE* out = csv ? csv : stdout;
+   if (frame>1)
+   {
+      int n = frame-1;
+      double sum=0;
+      for (int k=0;k<n;k++)
+         sum += ms[k];
+      qsort(ms,n,sizeof(float),CompareFloat);
+      fprintf(stderr,"Frames=%d  Mean=%.3fms  Min=%.3fms  Median=%.3fms  99%%=%.3fms  Max=%.3fms\n",
+              n,sum/n,ms[0],ms[n/2],ms[(int)(0.99*(n-1))],ms[n-1]);
+   }
+   if (out!=stdout) fclose(out);
+   exit(0);
+}
+
+//
+//  End of frame (call after swapping buffers)
+//  During playback time the frame and advance the path
+//
+void PathFrame(void)
+{
+   if (frame<0) return;
+   //  Time the frame just drawn
+   glFinish();
+   double now = Now();
+   if (frame>0)
+   {
+      FILE* out = csv ? csv : stdout;
+      if (frame==1) fprintf(out,"frame,time,ms\n");
+      ms[frame-1] = 1000*(now-last);
+      fprintf(out,"%d,%.4f,%.3f\n",frame,frame*dt,ms[frame-1]);
+   }
+   last = now;
+   //  Advance simulated time and replay the keys that are due
+   frame++;
+   double t = frame*dt;
+   for (;next<nev && ev[next].t<=t;next++)
+   {
+      event_t* e = ev+next;
+      if (e->type==EV_END)
+         EndPlay();
+      else if (e->type==EV_KEY && keyfunc)
+         keyfunc(e->key,0,0);
+      else if (e->type==EV_SPECIAL && specfunc)
+         specfunc(e->key,0,0);
+      //  Keep to the recorded path
+      if (SetState(e) && !warn)
+      {
+         fprintf(stderr,"Camera path diverged at %.3fs\n",e->t);
+         warn = 1;
+      }
+   }
+   //  Keep drawing
+   glutPostRedisplay();
+}
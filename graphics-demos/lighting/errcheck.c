@@ -2,11 +2,79 @@
 //  Willem A. (Vlakkies) Schreuder
 #include "CSCIx229.h"
 
+//
+//  OpenGL error reporting
+//
+//  Calling glGetError every frame can stall the pipeline while the driver
+//  catches up.  When KHR_debug is available the driver reports errors
+//  through a callback instead, and ErrCheck only notes where the program
+//  is so the report can say where the error happened.  Otherwise
+//  ErrCheck falls back to glGetError.
+//
+//  When NDEBUG is defined (release builds) ErrCheck only tests a flag
+//  unless --gl-debug is given.  Running with --gl-debug makes the callback
+//  synchronous, so errors are reported inside the offending call, and also
+//  reports warnings.
+//
+
+int ErrCheckOn=0;             //  ErrCheck enabled in NDEBUG builds
+static int debug=0;           //  --gl-debug given
+static int callback=0;        //  Debug callback installed
+//  Last checkpoint
+static const char* volatile at="";
+static const char* volatile atfile=NULL;
+static volatile int atline=0;
+
+#ifdef GL_VERSION_4_3
+//
+//  Report debug message
+//
+static void APIENTRY Report(GLenum source,GLenum type,GLuint id,GLenum severity,GLsizei length,const GLchar* message,const void* user)
+{
+   //  Only errors unless debugging
+   if (type!=GL_DEBUG_TYPE_ERROR && !debug) return;
+   if (severity==GL_DEBUG_SEVERITY_NOTIFICATION) return;
+   const char* kind = type==GL_DEBUG_TYPE_ERROR ? "ERROR" : "WARNING";
+   if (atfile)
+      fprintf(stderr,"%s: %s [after %s at %s:%d]\n",kind,message,at,atfile,atline);
+   else
+      fprintf(stderr,"%s: %s\n",kind,message);
+}
+#endif
+
+//
+//  Install debug callback (call once after the window is created)
+//    --gl-debug  report synchronously and include warnings
+//
+void ErrCheckInit(int argc,char* argv[])
+{
+   for (int k=1;k<argc;k++)
+      if (!strcmp(argv[k],"--gl-debug")) debug = ErrCheckOn = 1;
+#ifdef GL_VERSION_4_3
+   const char* ver = (const char*)glGetString(GL_VERSION);
+   const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+   if ((ver && atof(ver)>=4.3) || (ext && strstr(ext,"GL_KHR_debug")))
+   {
+      glDebugMessageCallback(Report,NULL);
+      glEnable(GL_DEBUG_OUTPUT);
+      if (debug) glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+      callback = 1;
+   }
+#endif
+   if (debug && !callback) fprintf(stderr,"KHR_debug is not available, using glGetError\n");
+}
+
 //
 //  Check for OpenGL errors and print to stderr
+//  Use the ErrCheck(where) macro, which adds the source location
 //
-void ErrCheck(const char* where)
+void ErrCheckAt(const char* where,const char* file,int line)
 {
+   at = where;
+   atfile = file;
+   atline = line;
+   //  The callback reports errors
+   if (callback) return;
    int err = glGetError();
-   if (err) fprintf(stderr,"ERROR: %s [%s]\n",gluErrorString(err),where);
+   if (err) fprintf(stderr,"ERROR: %s [%s at %s:%d]\n",gluErrorString(err),where,file,line);
 }
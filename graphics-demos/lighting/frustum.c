@@ -0,0 +1,179 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  View frustum culling
+//
+//  The six planes are extracted from the combined projection and view
+//  matrix, so bounds tested against them must be in the same (world)
+//  coordinates the view matrix was applied to.  A plane (a,b,c,d) has a
+//  unit normal pointing into the frustum: a*x+b*y+c*z+d is the signed
+//  distance of (x,y,z) from it.
+//
+//  The batched tests take bounds as separate x, y, z, ... arrays and test
+//  eight of them per iteration with GCC vectors (one AVX register or two
+//  SSE registers), so culling a whole scene is a handful of instructions.
+//  Other compilers test one at a time.
+//
+
+//
+//  Frustum of clip matrix m (projection times view)
+//
+frustum_t Frustum(Mat4 m)
+{
+   frustum_t f;
+   //  Rows of m
+   Vec4f r[4];
+   for (int i=0;i<4;i++)
+      r[i] = (Vec4f){V4(m.c[0],i),V4(m.c[1],i),V4(m.c[2],i),V4(m.c[3],i)};
+   //  Left, right, bottom, top, near, far
+   for (int i=0;i<3;i++)
+   {
+      f.p[2*i]   = Vec4fAdd(r[3],r[i]);
+      f.p[2*i+1] = Vec4fSub(r[3],r[i]);
+   }
+   //  Normalize so distances are in world units
+   for (int i=0;i<6;i++)
+   {
+      Vec4f p = f.p[i];
+      float l = sqrtf(V4(p,0)*V4(p,0)+V4(p,1)*V4(p,1)+V4(p,2)*V4(p,2));
+      if (l>0) f.p[i] = Vec4fScale(p,1/l);
+   }
+   return f;
+}
+
+//
+//  Frustum of the current OpenGL projection and modelview matrices
+//
+frustum_t FrustumGL(void)
+{
+   return Frustum(Mat4Mul(Mat4Get(GL_PROJECTION_MATRIX),Mat4Get(GL_MODELVIEW_MATRIX)));
+}
+
+//
+//  Sphere at (x,y,z) with radius r is at least partly inside
+//
+int SphereVisible(const frustum_t* f,float x,float y,float z,float r)
+{
+   for (int i=0;i<6;i++)
+   {
+      Vec4f p = f->p[i];
+      if (V4(p,0)*x+V4(p,1)*y+V4(p,2)*z+V4(p,3) < -r) return 0;
+   }
+   return 1;
+}
+
+//
+//  Box from (x0,y0,z0) to (x1,y1,z1) is at least partly inside
+//  (conservative: a box just outside a frustum corner may pass)
+//
+int BoxVisible(const frustum_t* f,float x0,float y0,float z0,float x1,float y1,float z1)
+{
+   for (int i=0;i<6;i++)
+   {
+      //  Corner furthest along the plane normal
+      Vec4f p = f->p[i];
+      float x = V4(p,0)>0 ? x1 : x0;
+      float y = V4(p,1)>0 ? y1 : y0;
+      float z = V4(p,2)>0 ? z1 : z0;
+      if (V4(p,0)*x+V4(p,1)*y+V4(p,2)*z+V4(p,3) < 0) return 0;
+   }
+   return 1;
+}
+
+#ifdef __GNUC__
+//  Eight floats and eight lane masks
+typedef float vec8 __attribute__ ((vector_size(32)));
+typedef int   int8 __attribute__ ((vector_size(32)));
+
+//
+//  Load eight floats (padding past n with the last value)
+//
+static void Load8(vec8* v,const float* a,int i,int n)
+{
+   if (i+8<=n)
+      memcpy(v,a+i,sizeof(*v));
+   else
+      for (int k=0;k<8;k++)
+         (*v)[k] = a[i+k<n ? i+k : n-1];
+}
+
+//
+//  Store eight lane masks as 0/1 bytes
+//
+static void Store8(unsigned char* vis,const int8* m,int i,int n)
+{
+   for (int k=0;k<8 && i+k<n;k++)
+      vis[i+k] = (*m)[k]!=0;
+}
+
+//
+//  Test n spheres, setting vis[i] to 1 if sphere i is at least partly inside
+//
+void SpheresVisible(const frustum_t* f,int n,const float x[],const float y[],const float z[],const float r[],unsigned char vis[])
+{
+   for (int i=0;i<n;i+=8)
+   {
+      vec8 X,Y,Z,R;
+      Load8(&X,x,i,n);
+      Load8(&Y,y,i,n);
+      Load8(&Z,z,i,n);
+      Load8(&R,r,i,n);
+      int8 in = X==X;
+      for (int j=0;j<6;j++)
+      {
+         Vec4f p = f->p[j];
+         in &= (p[0]*X + p[1]*Y + p[2]*Z + p[3]) >= -R;
+      }
+      Store8(vis,&in,i,n);
+   }
+}
+
+//
+//  Test n boxes from (x0,y0,z0) to (x1,y1,z1),
+//  setting vis[i] to 1 if box i is at least partly inside
+//
+void BoxesVisible(const frustum_t* f,int n,const float x0[],const float y0[],const float z0[],
+                                           const float x1[],const float y1[],const float z1[],unsigned char vis[])
+{
+   for (int i=0;i<n;i+=8)
+   {
+      vec8 X0,Y0,Z0,X1,Y1,Z1;
+      Load8(&X0,x0,i,n); Load8(&X1,x1,i,n);
+      Load8(&Y0,y0,i,n); Load8(&Y1,y1,i,n);
+      Load8(&Z0,z0,i,n); Load8(&Z1,z1,i,n);
+      int8 in = X0==X0;
+      for (int j=0;j<6;j++)
+      {
+         //  Corner furthest along the plane normal
+         Vec4f p = f->p[j];
+         vec8 X = p[0]>0 ? X1 : X0;
+         vec8 Y = p[1]>0 ? Y1 : Y0;
+         vec8 Z = p[2]>0 ? Z1 : Z0;
+         in &= (p[0]*X + p[1]*Y + p[2]*Z + p[3]) >= 0;
+      }
+      Store8(vis,&in,i,n);
+   }
+}
+#else
+//
+//  Test n spheres, setting vis[i] to 1 if sphere i is at least partly inside
+//
+void SpheresVisible(const frustum_t* f,int n,const float x[],const float y[],const float z[],const float r[],unsigned char vis[])
+{
+   for (int i=0;i<n;i++)
+      vis[i] = SphereVisible(f,x[i],y[i],z[i],r[i]);
+}
+
+//
+//  Test n boxes from (x0,y0,z0) to (x1,y1,z1),
+//  setting vis[i] to 1 if box i is at least partly inside
+//
+void BoxesVisible(const frustum_t* f,int n,const float x0[],const float y0[],const float z0[],
+                                           const float x1[],const float y1[],const float z1[],unsigned char vis[])
+{
+   for (int i=0;i<n;i++)
+      vis[i] = BoxVisible(f,x0[i],y0[i],z0[i],x1[i],y1[i],z1[i]);
+}
+#endif
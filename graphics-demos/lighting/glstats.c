@@ -0,0 +1,253 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  OpenGL call counting
+//
+//  With -DGLSTATS every counted entry point in CSCIx229.h is a macro that
+//  calls GlStatCount before the real function, so the counts work with any
+//  driver including Mesa's software rasterizer.  Calls made while a display
+//  list is compiled are tallied for that list and added to the frame each
+//  time glCallList runs it.  Triangles are worked out from the primitive
+//  type and vertex count of each glBegin/glEnd pair and draw call.
+//  GlStatFrame closes a frame and -glstats FILE logs every frame as CSV
+//  with one column per entry point.  GlStatHud shows one frame in every
+//  PERIOD so the HUD text is not redrawn every frame.  Only code built
+//  with -DGLSTATS is counted.
+//
+//  Without -DGLSTATS the library's own draw calls and those the program
+//  reports with GlDrawCount are counted, and GlDrawFrame returns the
+//  totals since its previous call.
+//
+
+//
+//  Triangles drawn by n vertices of primitive type mode
+//
+static unsigned int Triangles(unsigned int mode,int n)
+{
+   switch (mode)
+   {
+      case GL_TRIANGLES:      return n/3;
+      case GL_QUADS:          return n/4*2;
+      case GL_QUAD_STRIP:     return n<4 ? 0 : (n-2)/2*2;
+      case GL_TRIANGLE_STRIP:
+      case GL_TRIANGLE_FAN:
+      case GL_POLYGON:        return n<3 ? 0 : n-2;
+      default:                return 0;
+   }
+}
+
+#ifdef GLSTATS
+
+#define PERIOD 30   //  Frames between HUD updates
+
+//  Entry point names and categories
+#define X(fn,cat) #fn,
+static const char* name[GLSTAT_N] = {GLSTAT_LIST(X)};
+#undef X
+#define X(fn,cat) cat,
+static const int category[GLSTAT_N] = {GLSTAT_LIST(X)};
+#undef X
+
+//  Counts for a frame or a display list
+typedef struct
+{
+   unsigned int call[GLSTAT_N];  //  Calls per entry point
+   unsigned int calls;           //  Counted calls
+   unsigned int vertices;        //  Vertices submitted
+   unsigned int draws;           //  Primitives and draw calls
+   unsigned int triangles;       //  Triangles submitted
+   unsigned int state;           //  State changes
+} glstat_t;
+
+static glstat_t  frame;          //  Frame in progress
+static glstat_t  last;           //  Previous frame
+static glstat_t  shown;          //  Frame shown in the HUD
+static glstat_t* list=NULL;      //  Display lists
+static unsigned int nlist=0;     //  Size of list array
+static glstat_t* cur=&frame;     //  Where calls are counted
+static unsigned int compiled=0;  //  List being compiled
+static int execute=0;            //  List is also executed
+static int nframe=0;             //  Frames counted
+static unsigned int prim;        //  glBegin primitive
+static unsigned int begin;       //  Vertex count at glBegin
+static FILE* csv=NULL;           //  Frame log
+
+//
+//  Add counts b to a
+//
+static void Add(glstat_t* a,const glstat_t* b)
+{
+   for (int k=0;k<GLSTAT_N;k++)
+      a->call[k] += b->call[k];
+   a->calls     += b->calls;
+   a->vertices  += b->vertices;
+   a->draws     += b->draws;
+   a->triangles += b->triangles;
+   a->state     += b->state;
+}
+
+//
+//  Count one call
+//
+void GlStatCount(int id)
+{
+   cur->call[id]++;
+   cur->calls++;
+   switch (category[id])
+   {
+      case GLSTAT_VERTEX: cur->vertices++; break;
+      case GLSTAT_DRAW:   cur->draws++;    break;
+      case GLSTAT_STATE:  cur->state++;    break;
+   }
+}
+
+//
+//  Count a draw call submitting n vertices
+//
+void GlStatVertices(int id,unsigned int mode,int n)
+{
+   GlStatCount(id);
+   cur->vertices += n;
+   cur->triangles += Triangles(mode,n);
+}
+
+//
+//  Start an immediate mode primitive
+//
+void GlStatBegin(unsigned int m)
+{
+   GlStatCount(GLSTAT_glBegin);
+   prim = m;
+   begin = cur->vertices;
+}
+
+//
+//  End an immediate mode primitive
+//
+void GlStatEnd(void)
+{
+   GlStatCount(GLSTAT_glEnd);
+   cur->triangles += Triangles(prim,cur->vertices-begin);
+}
+
+//
+//  Start (list>0) or end (list=0) compiling a display list
+//
+void GlStatNewList(unsigned int l,unsigned int mode)
+{
+   if (l)
+   {
+      GlStatCount(GLSTAT_glNewList);
+      if (l>=nlist)
+      {
+         unsigned int n = 2*l+16;
+         list = (glstat_t*)realloc(list,n*sizeof(glstat_t));
+         if (!list) Fatal("Cannot allocate GL statistics\n");
+         memset(list+nlist,0,(n-nlist)*sizeof(glstat_t));
+         nlist = n;
+      }
+      //  Recompiling replaces the old list
+      memset(list+l,0,sizeof(glstat_t));
+      cur = list+l;
+      compiled = l;
+      execute = (mode==GL_COMPILE_AND_EXECUTE);
+   }
+   else
+   {
+      cur = &frame;
+      if (compiled && execute) Add(&frame,list+compiled);
+      compiled = 0;
+      GlStatCount(GLSTAT_glEndList);
+   }
+}
+
+//
+//  Add what a display list submits
+//
+void GlStatCallList(unsigned int l)
+{
+   GlStatCount(GLSTAT_glCallList);
+   if (l<nlist && l!=compiled) Add(cur,list+l);
+}
+
+//
+//  Parse options (call once at startup)
+//    -glstats FILE  log counts for every frame
+//
+void GlStatInit(int argc,char* argv[])
+{
+   for (int k=1;k+1<argc;k++)
+      if (!strcmp(argv[k],"-glstats"))
+      {
+         csv = fopen(argv[++k],"w");
+         if (!csv) Fatal("Cannot open %s\n",argv[k]);
+         fprintf(csv,"frame,calls,vertices,triangles,draws,state");
+         for (int i=0;i<GLSTAT_N;i++)
+            fprintf(csv,",%s",name[i]);
+         fprintf(csv,"\n");
+      }
+}
+
+//
+//  End of frame
+//
+void GlStatFrame(void)
+{
+   last = frame;
+   memset(&frame,0,sizeof(frame));
+   if (csv)
+   {
+      fprintf(csv,"%d,%u,%u,%u,%u,%u",nframe,last.calls,last.vertices,last.triangles,last.draws,last.state);
+      for (int i=0;i<GLSTAT_N;i++)
+         fprintf(csv,",%u",last.call[i]);
+      fprintf(csv,"\n");
+   }
+   if (nframe%PERIOD==0) shown = last;
+   nframe++;
+}
+
+//
+//  Show a recent frame as HUD lines k and k+1 at (x,y) going up
+//
+void GlStatHud(int k,int x,int y)
+{
+   //  Three busiest entry points
+   int top[3] = {-1,-1,-1};
+   for (int i=0;i<GLSTAT_N;i++)
+      for (int j=0;j<3;j++)
+         if (top[j]<0 || shown.call[i]>shown.call[top[j]])
+         {
+            for (int m=2;m>j;m--)
+               top[m] = top[m-1];
+            top[j] = i;
+            break;
+         }
+   HudLine(k,x,y,"GL calls=%u vertices=%u triangles=%u draws=%u state=%u",shown.calls,shown.vertices,shown.triangles,shown.draws,shown.state);
+   HudLine(k+1,x,y+20,"%s=%u %s=%u %s=%u",name[top[0]],shown.call[top[0]],name[top[1]],shown.call[top[1]],name[top[2]],shown.call[top[2]]);
+}
+#else
+
+static unsigned int draws=0;      //  Draw calls since GlDrawFrame
+static unsigned int triangles=0;  //  Triangles since GlDrawFrame
+
+//
+//  Count a draw call submitting n vertices of primitive type mode
+//
+void GlDrawCount(unsigned int mode,int n)
+{
+   draws++;
+   triangles += Triangles(mode,n);
+}
+
+//
+//  Return and reset the counts (call once per frame)
+//
+void GlDrawFrame(unsigned int* d,unsigned int* t)
+{
+   *d = draws;
+   *t = triangles;
+   draws = triangles = 0;
+}
+#endif
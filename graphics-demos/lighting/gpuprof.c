@@ -0,0 +1,219 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  GPU profiler
+//
+//  GpuBegin/GpuEnd bracket a named piece of rendering with GL_TIMESTAMP
+//  queries, so scopes may nest.  Queries come from a pool of FRAMES sets
+//  and GpuFrame reads back a set only once the GPU reports it available,
+//  normally a couple of frames later, so the profiler never waits for the
+//  GPU.  If the GPU falls FRAMES frames behind, the oldest set is dropped.
+//  Averages and maxima per scope name are updated every PERIOD frames;
+//  GpuHud shows them and -gpucsv FILE logs every measurement.
+//  Without timer queries (GL 3.3 or ARB_timer_query) nothing is measured.
+//
+
+#define FRAMES   4    //  Query sets in flight
+#define MAXSCOPE 32   //  Scopes per frame
+#define MAXNAME  16   //  Distinct scope names
+#define PERIOD   30   //  Frames per average
+
+//  Per scope statistics
+typedef struct
+{
+   const char* name;  //  Scope name
+   int n;             //  Measurements this period
+   double sum,max;    //  Total and largest time this period (ms)
+   double avg,peak;   //  Average and largest time last period (ms)
+} gpustat_t;
+static gpustat_t stat[MAXNAME];
+static int nstat=0;
+
+//  Queries for one frame
+typedef struct
+{
+   unsigned int q[MAXSCOPE][2];  //  Begin and end timestamps
+   int id[MAXSCOPE];             //  Statistics index
+   int n;                        //  Scopes used
+   int frame;                    //  Frame number
+   int pending;                  //  Waiting for results
+} gpuset_t;
+static gpuset_t set[FRAMES];
+
+static int timer=-1;      //  Timer queries available (-1=not checked yet)
+static int frame=0;       //  Current frame
+static int stack[MAXSCOPE];//  Open scopes
+static int depth=0;       //  Number of open scopes
+static int period=0;      //  Frames read back this period
+static int dropped=0;     //  Query sets dropped
+static FILE* csv=NULL;    //  Measurement log
+
+//
+//  Check for timer queries and create the pool
+//
+static int HasTimer(void)
+{
+   if (timer>=0) return timer;
+   timer = 0;
+#ifdef GL_VERSION_3_3
+   const char* ver = (const char*)glGetString(GL_VERSION);
+   const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+   if (!(ver && atof(ver)>=3.3) && !(ext && strstr(ext,"GL_ARB_timer_query"))) return 0;
+   int bits=0;
+   glGetQueryiv(GL_TIMESTAMP,GL_QUERY_COUNTER_BITS,&bits);
+   if (!bits) return 0;
+   for (int k=0;k<FRAMES;k++)
+      glGenQueries(2*MAXSCOPE,set[k].q[0]);
+   timer = 1;
+#endif
+   return timer;
+}
+
+//
+//  Parse profiler options (call after the window is created)
+//    -gpucsv FILE  log every measurement to FILE
+//
+void GpuInit(int argc,char* argv[])
+{
+   for (int k=1;k+1<argc;k++)
+      if (!strcmp(argv[k],"-gpucsv"))
+      {
+         csv = fopen(argv[++k],"w");
+         if (!csv) Fatal("Cannot open %s\n",argv[k]);
+         fprintf(csv,"frame,scope,ms\n");
+      }
+   if (!HasTimer()) fprintf(stderr,"Timer queries are not available, GPU profiling disabled\n");
+}
+
+//
+//  Statistics index for name
+//
+static int StatId(const char* name)
+{
+   for (int k=0;k<nstat;k++)
+      if (stat[k].name==name || !strcmp(stat[k].name,name)) return k;
+   if (nstat>=MAXNAME) return -1;
+   stat[nstat].name = name;
+   return nstat++;
+}
+
+//
+//  Start timing a named scope (name must stay valid, e.g. a literal)
+//
+void GpuBegin(const char* name)
+{
+   if (depth>=MAXSCOPE) Fatal("GPU scopes nested too deep\n");
+   gpuset_t* s = set+frame%FRAMES;
+   int id = HasTimer() ? StatId(name) : -1;
+   //  Out of queries or names
+   if (id<0 || s->n>=MAXSCOPE)
+   {
+      stack[depth++] = -1;
+      return;
+   }
+#ifdef GL_VERSION_3_3
+   glQueryCounter(s->q[s->n][0],GL_TIMESTAMP);
+#endif
+   s->id[s->n] = id;
+   stack[depth++] = s->n++;
+}
+
+//
+//  Stop timing the innermost scope
+//
+void GpuEnd(void)
+{
+   if (depth<=0) Fatal("GpuEnd without GpuBegin\n");
+   int k = stack[--depth];
+   if (k<0) return;
+#ifdef GL_VERSION_3_3
+   glQueryCounter(set[frame%FRAMES].q[k][1],GL_TIMESTAMP);
+#endif
+}
+
+//
+//  Read back a query set that is complete
+//
+static int Collect(gpuset_t* s)
+{
+#ifdef GL_VERSION_3_3
+   //  Queries complete in order, so checking the last one is enough
+   int ready=0;
+   glGetQueryObjectiv(s->q[s->n-1][1],GL_QUERY_RESULT_AVAILABLE,&ready);
+   if (!ready) return 0;
+   for (int k=0;k<s->n;k++)
+   {
+      GLuint64 t0,t1;
+      glGetQueryObjectui64v(s->q[k][0],GL_QUERY_RESULT,&t0);
+      glGetQueryObjectui64v(s->q[k][1],GL_QUERY_RESULT,&t1);
+      double ms = 1e-6*(t1-t0);
+      gpustat_t* g = stat+s->id[k];
+      g->n++;
+      g->sum += ms;
+      if (ms>g->max) g->max = ms;
+      if (csv) fprintf(csv,"%d,%s,%.4f\n",s->frame,g->name,ms);
+   }
+#endif
+   s->pending = 0;
+   return 1;
+}
+
+//
+//  End of frame - call after the last GpuEnd of the frame
+//
+void GpuFrame(void)
+{
+   if (depth) Fatal("GpuBegin without GpuEnd\n");
+   if (!HasTimer()) return;
+   //  Hand the current set to the GPU
+   gpuset_t* s = set+frame%FRAMES;
+   s->frame = frame;
+   s->pending = s->n>0;
+   frame++;
+   //  Read back finished sets oldest first
+   //  (leave the set just submitted for next frame)
+   for (int k=frame-FRAMES;k<frame-1;k++)
+   {
+      if (k<0) continue;
+      s = set+k%FRAMES;
+      if (!s->pending) continue;
+      if (!Collect(s)) break;
+      period++;
+   }
+   //  The next set must be free, drop it if the GPU is that far behind
+   s = set+frame%FRAMES;
+   if (s->pending)
+   {
+      s->pending = 0;
+      dropped++;
+   }
+   s->n = 0;
+   //  Publish averages
+   if (period>=PERIOD)
+   {
+      for (int k=0;k<nstat;k++)
+      {
+         gpustat_t* g = stat+k;
+         g->avg  = g->n ? g->sum/g->n : 0;
+         g->peak = g->max;
+         g->n = 0;
+         g->sum = g->max = 0;
+      }
+      period = 0;
+   }
+}
+
+//
+//  Show averages as HUD lines k, k+1, ... starting at (x,y) going up
+//
+void GpuHud(int k,int x,int y)
+{
+   if (!timer)
+      HudLine(k,x,y,"GPU timers not available");
+   for (int i=0;i<nstat && k+i<HUDLINES;i++,y+=20)
+      HudLine(k+i,x,y,"GPU %-8s %6.3fms  max %6.3fms",stat[i].name,stat[i].avg,stat[i].peak);
+   if (dropped && k+nstat<HUDLINES)
+      HudLine(k+nstat,x,y,"GPU results dropped %d",dropped);
+}
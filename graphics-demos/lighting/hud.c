@@ -0,0 +1,479 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+//  Cached HUD layer
+//
+//  HudLine formats a status line and keeps a hash of the text, position and
+//  color.  HudQuads does the same for a line made of colored quads such as
+//  a graph.  HudDraw re-renders only lines whose hash changed into an
+//  offscreen texture the size of the viewport and then composites that
+//  texture over the scene with one quad per line.  Lines that were not set
+//  since the previous HudDraw are removed.  In steady state a frame costs
+//  one vsnprintf and hash per line and a single draw call.
+//  Without framebuffer objects the lines are printed every frame.
+//
+
+#define LEN     8192               //  Maximum length of text string
+#define FONT    GLUT_BITMAP_HELVETICA_18
+#define ASC     20                 //  Text height above the raster position
+#define DESC    6                  //  Text depth below the raster position
+
+//  HUD line
+typedef struct
+{
+   char* text;          //  Text (NULL=empty)
+   int size;            //  Bytes allocated for text
+   float* quad;         //  Quad vertices (x,y,r,g,b,a) drawn instead of text
+   int nquad;           //  Quad vertices (0=text line)
+   int qsize;           //  Quad vertices allocated
+   int x,y;             //  Window position
+   float color[4];      //  Text color
+   unsigned int hash;   //  Hash of text, position and color
+   int used;            //  Set since the last HudDraw
+   int dirty;           //  Needs to be redrawn
+   int rect[4];         //  Pixels last drawn (x0,y0,x1,y1)
+} hudline_t;
+static hudline_t line[HUDLINES];
+
+//  Offscreen layer
+static int fbo=-1;      //  Framebuffer (0=none -1=not created yet)
+static unsigned int tex;//  Layer texture
+static int tw,th;       //  Layer size
+static double spent=0;  //  Time of the last HudDraw (s)
+
+//
+//  Wall clock in seconds
+//
+static double Now(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER f,c;
+   QueryPerformanceFrequency(&f);
+   QueryPerformanceCounter(&c);
+   return (double)c.QuadPart/f.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
+
+//
+//  FNV-1a hash
+//
+static unsigned int Hash(unsigned int h,const void* data,int n)
+{
+   const unsigned char* p = (const unsigned char*)data;
+   for (int i=0;i<n;i++)
+      h = (h^p[i])*16777619u;
+   return h;
+}
+
+//
+//  Set HUD line k at window position (x,y) in the current color
+//
+void HudLine(int k,int x,int y,const char* format , ...)
+{
+   char    buf[LEN];
+   va_list args;
+   if (k<0 || k>=HUDLINES) Fatal("HUD line %d out of range 0-%d\n",k,HUDLINES-1);
+   //  Turn the parameters into a character string
+   va_start(args,format);
+   vsnprintf(buf,LEN,format,args);
+   va_end(args);
+   //  Hash text, position and color
+   hudline_t* l = line+k;
+   float color[4];
+   glGetFloatv(GL_CURRENT_COLOR,color);
+   unsigned int h = Hash(2166136261u,buf,strlen(buf));
+   h = Hash(h,&x,sizeof(x));
+   h = Hash(h,&y,sizeof(y));
+   h = Hash(h,color,sizeof(color));
+   l->used = 1;
+   if (l->text && l->hash==h) return;
+   //  Store changed line (the buffer only grows)
+   int len = strlen(buf)+1;
+   if (!l->text || len>l->size)
+   {
+      MemFree(l->text);
+      l->text = (char*)MemAlloc(MEM_TEXT,len);
+      if (!l->text) Fatal("Cannot allocate memory for HUD line\n");
+      l->size = len;
+   }
+   strcpy(l->text,buf);
+   l->nquad = 0;
+   l->x = x;
+   l->y = y;
+   memcpy(l->color,color,sizeof(color));
+   l->hash  = h;
+   l->dirty = 1;
+}
+
+//
+//  Set HUD line k to n vertices of quads with window position (x,y)
+//  and color (r,g,b,a) in each row of v
+//
+void HudQuads(int k,int n,const float v[][6])
+{
+   if (k<0 || k>=HUDLINES) Fatal("HUD line %d out of range 0-%d\n",k,HUDLINES-1);
+   hudline_t* l = line+k;
+   unsigned int h = Hash(2166136261u,v,n*sizeof(v[0]));
+   l->used = 1;
+   if (l->text && l->nquad==n && l->hash==h) return;
+   //  Store changed quads with empty text (the buffers only grow)
+   if (!l->text)
+   {
+      l->text = (char*)MemAlloc(MEM_TEXT,1);
+      if (!l->text) Fatal("Cannot allocate memory for HUD line\n");
+      l->size = 1;
+   }
+   if (n>l->qsize)
+   {
+      MemFree(l->quad);
+      l->quad = (float*)MemAlloc(MEM_TEXT,n*sizeof(v[0]));
+      if (!l->quad) Fatal("Cannot allocate memory for HUD quads\n");
+      l->qsize = n;
+   }
+   l->text[0] = 0;
+   memcpy(l->quad,v,n*sizeof(v[0]));
+   l->nquad = n;
+   l->hash  = h;
+   l->dirty = 1;
+}
+
+//
+//  Draw n vertices of quads in window coordinates
+//
+static void Quads(const float* v,int n)
+{
+   int vp[4];
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glPushAttrib(GL_ENABLE_BIT|GL_POLYGON_BIT|GL_TRANSFORM_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(0,vp[2],0,vp[3],-1,1);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_CULL_FACE);
+   glDisable(GL_FOG);
+   glDisable(GL_ALPHA_TEST);
+   glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+   glVertexPointer(2,GL_FLOAT,6*sizeof(float),v);
+   glColorPointer(4,GL_FLOAT,6*sizeof(float),v+2);
+   glDrawArrays(GL_QUADS,0,n);
+   GlDrawCount(GL_QUADS,n);
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+}
+
+//
+//  Check for framebuffer objects
+//
+#ifdef GL_VERSION_3_0
+static int HasFBO(void)
+{
+   const char* ver = (const char*)glGetString(GL_VERSION);
+   const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+   return (ver && atoi(ver)>=3) || (ext && strstr(ext,"GL_ARB_framebuffer_object"));
+}
+
+//
+//  Rectangles overlap
+//
+static int Overlap(const int a[4],const int b[4])
+{
+   return a[0]<b[2] && b[0]<a[2] && a[1]<b[3] && b[1]<a[3];
+}
+
+//
+//  (Re)create layer to match the viewport
+//
+static void Resize(int w,int h)
+{
+   unsigned int fb;
+   if (fbo<0)
+   {
+      if (!HasFBO())
+      {
+         fbo = 0;
+         return;
+      }
+      glGenFramebuffers(1,&fb);
+      glGenTextures(1,&tex);
+      fbo = fb;
+   }
+   //  New texture size
+   tw = w;
+   th = h;
+   glPushAttrib(GL_TEXTURE_BIT);
+   glBindTexture(GL_TEXTURE_2D,tex);
+   glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,tw,th,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   MemGL(MEM_TEXOBJ,tex,MEM_TEXT,4*(size_t)tw*th);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+   glPopAttrib();
+   //  Attach and clear
+   int bound;
+   glGetIntegerv(GL_FRAMEBUFFER_BINDING,&bound);
+   fb = fbo;
+   glBindFramebuffer(GL_FRAMEBUFFER,fb);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,tex,0);
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+   {
+      glBindFramebuffer(GL_FRAMEBUFFER,bound);
+      glDeleteFramebuffers(1,&fb);
+      glDeleteTextures(1,&tex);
+      MemGL(MEM_TEXOBJ,tex,MEM_TEXT,0);
+      fbo = 0;
+      return;
+   }
+   glPushAttrib(GL_COLOR_BUFFER_BIT|GL_SCISSOR_BIT);
+   glDisable(GL_SCISSOR_TEST);
+   glClearColor(0,0,0,0);
+   glClear(GL_COLOR_BUFFER_BIT);
+   glPopAttrib();
+   glBindFramebuffer(GL_FRAMEBUFFER,bound);
+   //  Everything must be drawn again
+   for (int k=0;k<HUDLINES;k++)
+   {
+      line[k].dirty = 1;
+      memset(line[k].rect,0,sizeof(line[k].rect));
+   }
+}
+
+//
+//  Redraw changed lines into the layer
+//
+static void Render(void)
+{
+   //  Lines overlapping a cleared area must be drawn again, which clears
+   //  their area too, so repeat until no more lines become dirty
+   for (int more=1;more;)
+   {
+      more = 0;
+      for (int k=0;k<HUDLINES;k++)
+         if (line[k].dirty)
+            for (int i=0;i<HUDLINES;i++)
+               if (!line[i].dirty && line[i].text && Overlap(line[k].rect,line[i].rect))
+                  line[i].dirty = more = 1;
+   }
+   int bound;
+   unsigned int fb = fbo;
+   glGetIntegerv(GL_FRAMEBUFFER_BINDING,&bound);
+   glBindFramebuffer(GL_FRAMEBUFFER,fb);
+   glPushAttrib(GL_ALL_ATTRIB_BITS);
+   glViewport(0,0,tw,th);
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_TEXTURE_2D);
+   glDisable(GL_BLEND);
+   glClearColor(0,0,0,0);
+   //  Clear what changed lines drew last time
+   glEnable(GL_SCISSOR_TEST);
+   for (int k=0;k<HUDLINES;k++)
+   {
+      int* r = line[k].rect;
+      if (!line[k].dirty || r[2]<=r[0]) continue;
+      glScissor(r[0],r[1],r[2]-r[0],r[3]-r[1]);
+      glClear(GL_COLOR_BUFFER_BIT);
+   }
+   glDisable(GL_SCISSOR_TEST);
+   //  Draw them again
+   for (int k=0;k<HUDLINES;k++)
+   {
+      hudline_t* l = line+k;
+      if (!l->dirty) continue;
+      l->dirty = 0;
+      if (!l->text)
+      {
+         memset(l->rect,0,sizeof(l->rect));
+         continue;
+      }
+      if (l->nquad)
+      {
+         Quads(l->quad,l->nquad);
+         //  Bounding box of the quads
+         float x0=l->quad[0],y0=l->quad[1],x1=x0,y1=y0;
+         for (int i=1;i<l->nquad;i++)
+         {
+            const float* v = l->quad+6*i;
+            x0 = fmin(x0,v[0]);
+            y0 = fmin(y0,v[1]);
+            x1 = fmax(x1,v[0]);
+            y1 = fmax(y1,v[1]);
+         }
+         l->rect[0] = floor(x0);
+         l->rect[1] = floor(y0);
+         l->rect[2] = ceil(x1);
+         l->rect[3] = ceil(y1);
+         continue;
+      }
+      glColor4fv(l->color);
+      glWindowPos2i(l->x,l->y);
+      Print("%s",l->text);
+      l->rect[0] = l->x-2;
+      l->rect[1] = l->y-DESC;
+      l->rect[2] = l->x+glutBitmapLength(FONT,(const unsigned char*)l->text)+2;
+      l->rect[3] = l->y+ASC;
+   }
+   PrintFlush();
+   glPopAttrib();
+   glBindFramebuffer(GL_FRAMEBUFFER,bound);
+}
+
+//
+//  Composite layer over the viewport
+//
+static void Composite(void)
+{
+   //  One quad per line so only pixels near text are touched
+   float v[4*HUDLINES][4];
+   int n=0;
+   for (int k=0;k<HUDLINES;k++)
+   {
+      const int* l = line[k].rect;
+      int x0 = l[0]<0  ? 0  : l[0];
+      int y0 = l[1]<0  ? 0  : l[1];
+      int x1 = l[2]>tw ? tw : l[2];
+      int y1 = l[3]>th ? th : l[3];
+      if (x1<=x0 || y1<=y0) continue;
+      float s0 = (float)x0/tw, s1 = (float)x1/tw;
+      float t0 = (float)y0/th, t1 = (float)y1/th;
+      float q[4][4] = {{s0,t0,2*s0-1,2*t0-1},{s1,t0,2*s1-1,2*t0-1},{s1,t1,2*s1-1,2*t1-1},{s0,t1,2*s0-1,2*t1-1}};
+      memcpy(v[n],q,sizeof(q));
+      n += 4;
+   }
+   if (!n) return;
+   glPushAttrib(GL_ENABLE_BIT|GL_TEXTURE_BIT|GL_TRANSFORM_BIT|GL_COLOR_BUFFER_BIT|GL_POLYGON_BIT|GL_CURRENT_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glMatrixMode(GL_TEXTURE);
+   glPushMatrix();
+   glLoadIdentity();
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   glDisable(GL_DEPTH_TEST);
+   glDisable(GL_LIGHTING);
+   glDisable(GL_CULL_FACE);
+   glDisable(GL_FOG);
+   glDisable(GL_TEXTURE_GEN_S);
+   glDisable(GL_TEXTURE_GEN_T);
+   glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+   glEnable(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D,tex);
+   glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_REPLACE);
+   glEnable(GL_ALPHA_TEST);
+   glAlphaFunc(GL_GREATER,0);
+   //  Blend so translucent quads stay translucent
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glDisableClientState(GL_NORMAL_ARRAY);
+   glDisableClientState(GL_COLOR_ARRAY);
+   glTexCoordPointer(2,GL_FLOAT,4*sizeof(float),v[0]);
+   glVertexPointer(2,GL_FLOAT,4*sizeof(float),v[0]+2);
+   glDrawArrays(GL_QUADS,0,n);
+   GlDrawCount(GL_QUADS,n);
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_TEXTURE);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+}
+#endif
+
+//
+//  Draw HUD - call once per frame after the HUD lines are set
+//
+void HudDraw(void)
+{
+   TraceScope("HudDraw");
+   double t0 = Now();
+   //  Drop lines that were not set this frame
+   for (int k=0;k<HUDLINES;k++)
+   {
+      if (!line[k].used && line[k].text)
+      {
+         MemFree(line[k].text);
+         MemFree(line[k].quad);
+         line[k].text  = NULL;
+         line[k].quad  = NULL;
+         line[k].size  = 0;
+         line[k].nquad = 0;
+         line[k].qsize = 0;
+         line[k].dirty = 1;
+      }
+      line[k].used = 0;
+   }
+   //  Text queued so far belongs to the scene
+   PrintFlush();
+#ifdef GL_VERSION_3_0
+   //  Match layer to the viewport
+   int vp[4];
+   glGetIntegerv(GL_VIEWPORT,vp);
+   if (fbo<0 || (fbo && (vp[2]!=tw || vp[3]!=th)))
+      Resize(vp[2],vp[3]);
+   if (fbo)
+   {
+      //  Redraw changed lines and composite
+      for (int k=0;k<HUDLINES;k++)
+         if (line[k].dirty)
+         {
+            Render();
+            break;
+         }
+      Composite();
+      spent = Now()-t0;
+      return;
+   }
+#endif
+   //  Print every line
+   glPushAttrib(GL_CURRENT_BIT|GL_COLOR_BUFFER_BIT);
+   glEnable(GL_BLEND);
+   glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+   for (int k=0;k<HUDLINES;k++)
+      if (line[k].nquad)
+         Quads(line[k].quad,line[k].nquad);
+      else if (line[k].text)
+      {
+         glColor4fv(line[k].color);
+         glWindowPos2i(line[k].x,line[k].y);
+         Print("%s",line[k].text);
+      }
+   glPopAttrib();
+   PrintFlush();
+   spent = Now()-t0;
+}
+
+//
+//  Seconds spent in the last HudDraw
+//
+double HudTime(void)
+{
+   return spent;
+}
@@ -9,18 +9,35 @@
  *  f          Toggle smooth/flat shading
  *  v          Toggle local viewer mode
  *  k          Toggle light distance (1/5)
- *  i/I        Decrease/Increase ball increment
+ *  i/I        Decrease/Increase ball increment (finest, used up close)
  *  b          Invert bottom normal
  *  m          Toggles light movement
  *  []         Lower/rise light
  *  p          Toggles ortogonal/perspective projection
- *  o          Cycles through objects
+ *  o          Cycles through objects (the last is an instanced forest)
+ *  c/C        Decrease/increase forest size tenfold
  *  +/-        Change field of view of perspective
  *  x          Toggle axes
+ *  t          Toggle procedural textures
+ *  g          Cycle performance overlay and memory page
  *  arrows     Change view angle
  *  6/7  Zoom in and out
  *  0          Reset view angle
  *  ESC        Exit
+ *
+ *  Options:
+ *  -record FILE  Record key presses as a camera path
+ *  -play FILE    Replay a camera path on a fixed timestep and print frame times
+ *  -dt SEC       Timestep for -play (default 1/60s)
+ *  -csv FILE     Write frame times to FILE
+ *  --gl-debug   Report OpenGL errors and warnings where they happen
+ *  -gpucsv FILE  Log GPU time of every pass to FILE
+ *  -trace FILE   Write a Chrome trace of the last frames at exit (built with -DTRACE)
+ *  -glstats FILE Log GL call counts of every frame (built with -DGLSTATS)
+ *  -startup      Print the startup timeline
+ *  -eager        Build textures on first use instead of spreading them over frames
+ *  -forest N     Number of objects in the instanced forest (default 50000)
+ *  -ground FILE  Draw an uncompressed BMP of any size as a tiled ground under the scene
  */
 #include "CSCIx229.h"
 
@@ -31,6 +48,9 @@ int th=30;        //  Azimuth of view angle (start angled)
 int ph=25;        //  Elevation of view angle (start angled)
 int fov=55;       //  Field of view (for perspective)
 int obj=0;        //  Scene/opbject selection
+int textures=1;   //  Procedural textures
+int forest=50000; //  Objects in the instanced forest
+tiled_t* ground=NULL; //  Tiled ground texture
 double asp=1;     //  Aspect ratio
 double dim=6.0;   //  Size of world (start zoomed out)
 // Light values
@@ -46,10 +66,7 @@ int shininess =   0;  // Shininess (power of two)
 float shiny   =   1;  // Shininess (value)
 int zh        =  90;  // Light azimuth
 float ylight  =   0;  // Elevation of light
-typedef struct {float x,y,z;} vtx;
-typedef struct {int A,B,C;} tri;
-#define n 500
-vtx is[n];
+mat4stack_t mv;       // Modelview for objects sized on screen
 
 // Color/Material structs later passed as references into composite shapes. 
 // Pattern referenced from OpenGl Primer, 3ed, Chapter 6.5 - Specifying a Material
@@ -70,18 +87,208 @@ static const Color    BULB_DFLT  = {1.00f,1.00f,0.90f};
 static const Color    AMBER_DARK = {0.85f,0.55f,0.10f};
 
 /*
- *  Draw vertex in polar coordinates with normal
- *  Note: This was taken from ex13.c
+ *  Indexed triangle mesh in memory
+ */
+typedef struct {
+   float* xyz;            //  Positions (each followed by its normal)
+   unsigned short* idx;   //  Triangle indices
+   int nv;                //  Number of vertices
+   int nidx;              //  Number of indices
+   int normals;           //  Normals follow each position (0=same as position)
+} Geom;
+
+/*
+ *  Allocate a mesh of nv vertices and nidx indices
+ */
+static Geom geomAlloc(int nv,int normals,int nidx)
+{
+   Geom g = {NULL,NULL,nv,nidx,normals};
+   g.xyz = (float*)MemAlloc(MEM_TEMP,(normals?6:3)*nv*sizeof(float));
+   g.idx = (unsigned short*)MemAlloc(MEM_TEMP,nidx*sizeof(unsigned short));
+   if (!g.xyz || !g.idx) Fatal("Cannot allocate mesh\n");
+   return g;
+}
+
+/*
+ *  Release a mesh in memory
+ */
+static void geomFree(Geom* g)
+{
+   MemFree(g->xyz);
+   MemFree(g->idx);
+}
+
+/*
+ *  Indexed triangle meshes kept in buffer objects
+ *  Each is built once for the parameters in key and reused after that
+ *  When all MESHES are in use the oldest is rebuilt for the new key
+ */
+#define MESHES 16
+typedef struct {
+   float key[6];          //  Shape and parameters
+   unsigned int vbo,ibo;  //  Vertex and index buffers
+   int nv;                //  Number of vertices
+   int nidx;              //  Number of indices
+   int normals;           //  Normals follow each position (0=same as position)
+} Mesh;
+static Mesh mesh[MESHES];
+static int nmesh=0;
+
+/*
+ *  Cached mesh for key (NULL if not built yet)
+ */
+static Mesh* meshFind(const float key[6])
+{
+   for (int k=0;k<MESHES && k<nmesh;k++)
+      if (!memcmp(mesh[k].key,key,sizeof(mesh[k].key))) return mesh+k;
+   return NULL;
+}
+
+/*
+ *  Copy vertices and triangle indices to buffer objects for key
+ *  and release the mesh in memory
+ */
+static Mesh* meshStore(const float key[6],Geom* g)
+{
+   Mesh* m = mesh+(nmesh++%MESHES);
+   const float* xyz = g->xyz;
+   const unsigned short* idx = g->idx;
+   int nv = g->nv;
+   int nidx = g->nidx;
+   int normals = g->normals;
+   int nf = normals ? 6 : 3;
+   memcpy(m->key,key,sizeof(m->key));
+   if (!m->vbo) glGenBuffers(1,&m->vbo);
+   if (!m->ibo) glGenBuffers(1,&m->ibo);
+   glBindBuffer(GL_ARRAY_BUFFER,m->vbo);
+   glBufferData(GL_ARRAY_BUFFER,nf*nv*sizeof(float),xyz,GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m->ibo);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER,nidx*sizeof(unsigned short),idx,GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+   MemGL(MEM_BUFOBJ,m->vbo,MEM_MESH,nf*nv*sizeof(float));
+   MemGL(MEM_BUFOBJ,m->ibo,MEM_MESH,nidx*sizeof(unsigned short));
+   m->nv = nv;
+   m->nidx = nidx;
+   m->normals = normals;
+   geomFree(g);
+   return m;
+}
+
+/*
+ *  Draw cached mesh with one indexed call
+ */
+static void meshDraw(const Mesh* m)
+{
+   int stride = m->normals ? 6*sizeof(float) : 0;
+   glBindBuffer(GL_ARRAY_BUFFER,m->vbo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m->ibo);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_NORMAL_ARRAY);
+   glVertexPointer(3,GL_FLOAT,stride,(void*)0);
+   glNormalPointer(GL_FLOAT,stride,(void*)(m->normals ? 3*sizeof(float) : 0));
+   glDrawElements(GL_TRIANGLES,m->nidx,GL_UNSIGNED_SHORT,(void*)0);
+   GlDrawCount(GL_TRIANGLES,m->nidx);
+   glPopClientAttrib();
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+}
+
+/*
+ *  Grid of rows+1 by cols+1 vertices with two triangles for each cell
+ *  wound like a strip along the row (a,b,c and c,b,d)
+ */
+static Geom gridGeom(int rows,int cols,int normals)
+{
+   Geom g = geomAlloc((rows+1)*(cols+1),normals,6*rows*cols);
+   for (int j=0;j<rows;j++)
+      for (int i=0;i<cols;i++)
+      {
+         unsigned short a = j*(cols+1)+i;
+         unsigned short b = a+cols+1;
+         unsigned short t[6] = {a,b,a+1,a+1,b,b+1};
+         memcpy(g.idx+6*(j*cols+i),t,sizeof(t));
+      }
+   return g;
+}
+
+/*
+ *  Screen space tessellation
+ *  How many times (up to 2) segments spanning angle a (radians) on a
+ *  circle px pixels in radius can be doubled while staying within TESS
+ *  pixels of the circle
+ */
+#define TESS 0.5
+static int tessLevel(float px,float a)
+{
+   int k=0;
+   //  A segment of angle 2a is 1-cos(a) times the radius from the circle
+   while (k<2 && px*(1-cos(a))<=TESS)
+   {
+      a *= 2;
+      k++;
+   }
+   return k;
+}
+
+/*
+ *  Unit sphere with bands of latitude step degrees apart
+ *  Note: Tessellation taken from Vertex() in ex13.c
+ */
+static Geom sphereGeom(int step)
+{
+   //  Rows from the south pole every step degrees and columns every 2*step degrees
+   //  When step does not divide 180 the last row and column are narrower
+   //  For a sphere at the origin, the position and normal vectors are the same
+   int rows = (180+step-1)/step;
+   int cols = (180+step-1)/step;
+   Geom g = gridGeom(rows,cols,0);
+   for (int j=0;j<=rows;j++)
+      for (int i=0;i<=cols;i++)
+      {
+         float* v = g.xyz+3*(j*(cols+1)+i);
+         int th = i<cols ? 2*step*i   : 360;
+         int ph = j<rows ? -90+step*j : 90;
+         v[0] = Sin(th)*Cos(ph);
+         v[1] = Cos(th)*Cos(ph);
+         v[2] =         Sin(ph);
+      }
+   //  Check the seam meets the first column and the last row is the north pole
+   int open = fabs(g.xyz[3*rows*(cols+1)+2]-1)>1e-5;
+   for (int j=0;j<=rows;j++)
+   {
+      const float* v0 = g.xyz+3*j*(cols+1);
+      const float* v1 = v0+3*cols;
+      open |= fabs(v0[0]-v1[0])+fabs(v0[1]-v1[1])+fabs(v0[2]-v1[2])>1e-5;
+   }
+   if (open) Fatal("Sphere with step %d is not closed\n",step);
+   return g;
+}
+
+/*
+ *  Cached unit sphere
+ */
+static const Mesh* sphereMesh(int step)
+{
+   const float key[6] = {0,step,0,0,0,0};
+   Mesh* m = meshFind(key);
+   if (!m)
+   {
+      Geom g = sphereGeom(step);
+      m = meshStore(key,&g);
+   }
+   return m;
+}
+
+/*
+ *  Latitude step for a unit sphere at the origin of the modelview stack
+ *  inc when it is large on screen, up to four times coarser when small
  */
-static void Vertex(double th,double ph)
+static int sphereStep()
 {
-   double x = Sin(th)*Cos(ph);
-   double y = Cos(th)*Cos(ph);
-   double z =         Sin(ph);
-   //  For a sphere at the origin, the position
-   //  and normal vectors are the same
-   glNormal3d(x,y,z);
-   glVertex3d(x,y,z);
+   int step = inc << tessLevel(ProjectedRadius(StackTop(&mv),1),2*inc*M_PI/180);
+   return step<45 ? step : 45;
 }
 
 /*
@@ -92,39 +299,34 @@ static void Vertex(double th,double ph)
 static void ball(double x,double y,double z,double r)
 {
    //  Save transformation
-   glPushMatrix();
+   StackPush(&mv);
    //  Offset, scale and rotate
-   glTranslated(x,y,z);
-   glScaled(r,r,r);
+   StackTranslate(&mv,x,y,z);
+   StackScale(&mv,r,r,r);
+   Mat4Load(StackTop(&mv));
    //  White ball with yellow specular
    float yellow[]   = {1.0,1.0,0.0,1.0};
    float Emission[] = {0.0,0.0,0.01*emission,1.0};
    glColor3f(1,1,1);
-   glMaterialf(GL_FRONT,GL_SHININESS,shiny);
-   glMaterialfv(GL_FRONT,GL_SPECULAR,yellow);
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emission);
+   MaterialSetf(GL_FRONT,GL_SHININESS,shiny);
+   MaterialSet(GL_FRONT,GL_SPECULAR,yellow);
+   MaterialSet(GL_FRONT,GL_EMISSION,Emission);
    //  Bands of latitude
-   for (int ph=-90;ph<90;ph+=inc)
-   {
-      glBegin(GL_QUAD_STRIP);
-      for (int th=0;th<=360;th+=2*inc)
-      {
-         Vertex(th,ph);
-         Vertex(th,ph+inc);
-      }
-      glEnd();
-   }
+   meshDraw(sphereMesh(sphereStep()));
    //  Undo transofrmations
-   glPopMatrix();
+   StackPop(&mv);
+   Mat4Load(StackTop(&mv));
 }
 
 /*
  *  OpenGL (GLUT) calls this routine to display the scene
  */
 /*
- *  Emit a lit triangle given 3 vertices (computes flat-shaded normal)
+ *  Store a lit triangle given 3 vertices (computes flat-shaded normal)
+ *  as position and normal for each vertex in v[18]
  */
-static void triLit3f(float Ax,float Ay,float Az,
+static void triLit3f(float* v,
+                     float Ax,float Ay,float Az,
                      float Bx,float By,float Bz,
                      float Cx,float Cy,float Cz)
 {
@@ -133,37 +335,58 @@ static void triLit3f(float Ax,float Ay,float Az,
    float Nx = dy0*dz1 - dy1*dz0;
    float Ny = dz0*dx1 - dz1*dx0;
    float Nz = dx0*dy1 - dx1*dy0;
-   glNormal3f(Nx,Ny,Nz);
-   glBegin(GL_TRIANGLES);
-   glVertex3f(Ax,Ay,Az);
-   glVertex3f(Bx,By,Bz);
-   glVertex3f(Cx,Cy,Cz);
-   glEnd();
+   float T[18] = {Ax,Ay,Az,Nx,Ny,Nz, Bx,By,Bz,Nx,Ny,Nz, Cx,Cy,Cz,Nx,Ny,Nz};
+   memcpy(v,T,sizeof(T));
 }
 
 /*
- *  Jagged rock built from triangles
- *    positioned at (x,y,z) and uniformly scaled by s
+ *  Seed for procedural texture of an object placed at (x,z)
  */
-static void rockLit(double x,double y,double z,double s, const Material* mat)
+static unsigned int seedAt(double x,double z)
 {
-   const int N = 16;
-   const Material* M = mat ? mat : &ROCK_DFLT;
-   float A[4] = {M->ambient.r ,M->ambient.g ,M->ambient.b ,1.0f};
-   float D[4] = {M->diffuse.r ,M->diffuse.g ,M->diffuse.b ,1.0f};
-   float S[4] = {M->specular.r,M->specular.g,M->specular.b,1.0f};
-   float Em[4]= {0,0,0,1};
-   glMaterialfv(GL_FRONT_AND_BACK,GL_EMISSION,Em);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_AMBIENT ,A);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_DIFFUSE ,D);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,S);
-   glMaterialf (GL_FRONT_AND_BACK,GL_SHININESS,M->shininess);
+   return (unsigned int)(int)(100*x)*73856093u ^ (unsigned int)(int)(100*z)*19349663u;
+}
 
-   glPushMatrix();
-   glTranslated(x,y,z);
-   glScalef(s,s,s);
-   glColor3f(M->diffuse.r,M->diffuse.g,M->diffuse.b);
+/*
+ *  Bind procedural texture with object linear texture coordinates
+ *    s and t run along (1,0,1) and (0.5,1,-0.5) scaled by ss and st
+ */
+static void noiseTex(unsigned int tex,float ss,float st)
+{
+   //  Untextured until the texture is built
+   if (!textures || !tex) return;
+   float S[] = {ss,0,ss,0};
+   float T[] = {0.5f*st,st,-0.5f*st,0};
+   glEnable(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D,tex);
+   glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
+   glTexGeni(GL_S,GL_TEXTURE_GEN_MODE,GL_OBJECT_LINEAR);
+   glTexGeni(GL_T,GL_TEXTURE_GEN_MODE,GL_OBJECT_LINEAR);
+   glTexGenfv(GL_S,GL_OBJECT_PLANE,S);
+   glTexGenfv(GL_T,GL_OBJECT_PLANE,T);
+   glEnable(GL_TEXTURE_GEN_S);
+   glEnable(GL_TEXTURE_GEN_T);
+}
 
+/*
+ *  Stop procedural texturing
+ */
+static void noiseOff()
+{
+   glDisable(GL_TEXTURE_GEN_S);
+   glDisable(GL_TEXTURE_GEN_T);
+   glDisable(GL_TEXTURE_2D);
+}
+
+/*
+ *  Jagged rock mesh of unit size with flat-shaded triangles
+ */
+#define ROCK 16
+static Geom rockGeom()
+{
+   const int N = ROCK;
+   Geom g = geomAlloc(4*N*3,1,4*N*3);
+   float* v = g.xyz;
    for (int i=0;i<N;i++)
    {
       float a0 = 360.0f*i/N;
@@ -184,15 +407,61 @@ static void rockLit(double x,double y,double z,double s, const Material* mat)
       float x0b = r0b*Cos(a0), z0b = r0b*Sin(a0);
       float x1b = r1b*Cos(a1), z1b = r1b*Sin(a1);
 
+      float* t = v+4*18*i;
       // top cap
-      triLit3f(0.0f,0.7f,0.0f,  x0t,yt0,z0t,  x1t,yt1,z1t);
+      triLit3f(t   , 0.0f,0.7f,0.0f,  x0t,yt0,z0t,  x1t,yt1,z1t);
       // bottom cap
-      triLit3f(0.0f,-0.6f,0.0f, x1b,yb1,z1b,  x0b,yb0,z0b);
+      triLit3f(t+18, 0.0f,-0.6f,0.0f, x1b,yb1,z1b,  x0b,yb0,z0b);
       // side (split quad into two tris)
-      triLit3f(x0t,yt0,z0t,  x0b,yb0,z0b,  x1b,yb1,z1b);
-      triLit3f(x0t,yt0,z0t,  x1b,yb1,z1b,  x1t,yt1,z1t);
+      triLit3f(t+36, x0t,yt0,z0t,  x0b,yb0,z0b,  x1b,yb1,z1b);
+      triLit3f(t+54, x0t,yt0,z0t,  x1b,yb1,z1b,  x1t,yt1,z1t);
+   }
+   //  Vertices are not shared since every face has its own normal
+   for (int k=0;k<4*N*3;k++)
+      g.idx[k] = k;
+   return g;
+}
+
+/*
+ *  Rock built once and drawn from the mesh cache after that
+ */
+static const Mesh* rockMesh()
+{
+   const float key[6] = {2,ROCK,0,0,0,0};
+   Mesh* m = meshFind(key);
+   if (!m)
+   {
+      Geom g = rockGeom();
+      m = meshStore(key,&g);
    }
+   return m;
+}
 
+/*
+ *  Jagged rock built from triangles
+ *    positioned at (x,y,z) and uniformly scaled by s
+ */
+static void rockLit(double x,double y,double z,double s, const Material* mat)
+{
+   const Material* M = mat ? mat : &ROCK_DFLT;
+   float A[4] = {M->ambient.r ,M->ambient.g ,M->ambient.b ,1.0f};
+   float D[4] = {M->diffuse.r ,M->diffuse.g ,M->diffuse.b ,1.0f};
+   float S[4] = {M->specular.r,M->specular.g,M->specular.b,1.0f};
+   float Em[4]= {0,0,0,1};
+   MaterialSet (GL_FRONT_AND_BACK,GL_EMISSION,Em);
+   MaterialSet (GL_FRONT_AND_BACK,GL_AMBIENT ,A);
+   MaterialSet (GL_FRONT_AND_BACK,GL_DIFFUSE ,D);
+   MaterialSet (GL_FRONT_AND_BACK,GL_SPECULAR,S);
+   MaterialSetf(GL_FRONT_AND_BACK,GL_SHININESS,M->shininess);
+
+   glPushMatrix();
+   glTranslated(x,y,z);
+   glScalef(s,s,s);
+   glColor3f(M->diffuse.r,M->diffuse.g,M->diffuse.b);
+   //  Cellular stone pattern unique to this rock
+   noiseTex(NoiseTextureLazy(NOISE_WORLEY,seedAt(x,z),256,6,4),0.5,0.5);
+   meshDraw(rockMesh());
+   noiseOff();
    glPopMatrix();
 }
 
@@ -228,6 +497,17 @@ static void boxQuadsLit(float sx,float sy,float sz, float r,float g,float b)
    glPopMatrix();
 }
 
+// Tree boxes (trunk and three canopy levels) as center height, half width
+// in units of the canopy radius, half height in units of the tree height
+// and shade of the canopy color
+static const float treeBox[4][4] = {
+   {0.2f, 0.25f,0.4f, 1.00f},
+   {0.5f, 1.00f,0.2f, 1.00f},
+   {0.7f, 0.75f,0.2f, 0.85f},
+   {0.9f, 0.55f,0.2f, 0.70f},
+};
+static const Color TRUNK_COLOR = {0.45f,0.30f,0.20f};
+
 /*
  *  Tree constructed with GL_QUADS (trunk and layered canopy)
  *    at (x,y,z) with overall height h and canopy radius r
@@ -244,106 +524,115 @@ static void treeLit(double x,double y,double z,double h,double r,
       float A[4] = {TM->ambient.r ,TM->ambient.g ,TM->ambient.b ,1.0f};
       float D[4] = {TM->diffuse.r ,TM->diffuse.g ,TM->diffuse.b ,1.0f};
       float S[4] = {TM->specular.r,TM->specular.g,TM->specular.b,1.0f};
-      glMaterialfv(GL_FRONT_AND_BACK,GL_AMBIENT ,A);
-      glMaterialfv(GL_FRONT_AND_BACK,GL_DIFFUSE ,D);
-      glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,S);
-      glMaterialf (GL_FRONT_AND_BACK,GL_SHININESS,TM->shininess);
+      MaterialSet (GL_FRONT_AND_BACK,GL_AMBIENT ,A);
+      MaterialSet (GL_FRONT_AND_BACK,GL_DIFFUSE ,D);
+      MaterialSet (GL_FRONT_AND_BACK,GL_SPECULAR,S);
+      MaterialSetf(GL_FRONT_AND_BACK,GL_SHININESS,TM->shininess);
    }
 
-   // Trunk
+   // Trunk (bark grain stretched vertically)
+   const float* B = treeBox[0];
    glPushMatrix();
-   glTranslated(0, 0.2*h, 0);
-   boxQuadsLit(0.25f*r, 0.4f*h, 0.25f*r, 0.45f,0.30f,0.20f);
+   glTranslated(0, B[0]*h, 0);
+   noiseTex(NoiseTextureLazy(NOISE_PERLIN,seedAt(x,z),256,8,4),0.5,0.1);
+   boxQuadsLit(B[1]*r, B[2]*h, B[1]*r, TRUNK_COLOR.r,TRUNK_COLOR.g,TRUNK_COLOR.b);
    glPopMatrix();
 
    // Canopy levels
-   double baseY = 0.4*h;
-   double levelH = 0.2*h;
    const Color* CB = canopyBase ? canopyBase : &CANOPY_DFLT;
    // Low specular/shininess for canopy
    {
       float specLow[] = {0.02f,0.02f,0.02f,1.0f};
-      glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,specLow);
-      glMaterialf (GL_FRONT_AND_BACK,GL_SHININESS,2.0f);
+      MaterialSet (GL_FRONT_AND_BACK,GL_SPECULAR,specLow);
+      MaterialSetf(GL_FRONT_AND_BACK,GL_SHININESS,2.0f);
    }
+   // Foliage
+   noiseTex(NoiseTextureLazy(NOISE_PERLIN,seedAt(x,z)+1,256,16,3),0.5,0.5);
 
-   glPushMatrix();
-   glTranslated(0, baseY + 0.5*levelH, 0);
-   boxQuadsLit(1.00f*r, levelH, 1.00f*r, CB->r, CB->g, CB->b);
-   glPopMatrix();
-
-   glPushMatrix();
-   glTranslated(0, baseY + levelH + 0.5*levelH, 0);
-   boxQuadsLit(0.75f*r, levelH, 0.75f*r, 0.85f*CB->r, 0.85f*CB->g, 0.85f*CB->b);
-   glPopMatrix();
-
-   glPushMatrix();
-   glTranslated(0, baseY + 2*levelH + 0.5*levelH, 0);
-   boxQuadsLit(0.55f*r, levelH, 0.55f*r, 0.70f*CB->r, 0.70f*CB->g, 0.70f*CB->b);
-   glPopMatrix();
+   for (int k=1;k<4;k++)
+   {
+      B = treeBox[k];
+      glPushMatrix();
+      glTranslated(0, B[0]*h, 0);
+      boxQuadsLit(B[1]*r, B[2]*h, B[1]*r, B[3]*CB->r, B[3]*CB->g, B[3]*CB->b);
+      glPopMatrix();
+   }
 
+   noiseOff();
    glPopMatrix();
 }
 
 /*
- *  Torus using GL_TRIANGLE_STRIP with per-vertex normals
+ *  Torus with per-vertex normals
  *  R = major radius, r = minor radius, sweepDeg = degrees of sweep around major circle
  *  rings = segments along major circle (u), sides = segments around tube (v)
  *  Param:
  *    P(u,v) = ((R + r*cos v)*cos u, (R + r*cos v)*sin u, r*sin v)
  *    N(u,v) = (cos v*cos u, cos v*sin u, sin v)
  */
-static void torus(float R, float r, float sweepDeg, int rings, int sides)
+static Geom torusGeom(float R, float r, float sweepDeg, int rings, int sides)
 {
-   if (rings < 3) rings = 3;
-   if (sides < 3) sides = 3;
-   if (sweepDeg < 0) sweepDeg = 0;
-   if (sweepDeg > 360) sweepDeg = 360;
-
    float du = sweepDeg / (float)rings;
    float dv = 360.0f   / (float)sides;
+   Geom g = gridGeom(sides, rings, 1);
 
-   for (int j = 0; j < sides; ++j)
+   // row j runs along the major circle at tube angle v
+   for (int j = 0; j <= sides; ++j)
    {
-      float v0 = j * dv;
-      float v1 = (j + 1) * dv;
+      float v = j * dv;
+      float cv = cosf(v * (float)M_PI/180.0f);
+      float sv = sinf(v * (float)M_PI/180.0f);
 
-      float cv0 = cosf(v0 * (float)M_PI/180.0f);
-      float sv0 = sinf(v0 * (float)M_PI/180.0f);
-      float cv1 = cosf(v1 * (float)M_PI/180.0f);
-      float sv1 = sinf(v1 * (float)M_PI/180.0f);
-
-      glBegin(GL_TRIANGLE_STRIP);
       for (int i = 0; i <= rings; ++i)
       {
          float u = i * du;
          float cu = cosf(u * (float)M_PI/180.0f);
          float su = sinf(u * (float)M_PI/180.0f);
 
-         float x0 = (R + r*cv0) * cu;
-         float y0 = (R + r*cv0) * su;
-         float z0 = r*sv0;
-         float nx0 = cv0*cu;
-         float ny0 = cv0*su;
-         float nz0 = sv0;
-
-         float x1 = (R + r*cv1) * cu;
-         float y1 = (R + r*cv1) * su;
-         float z1 = r*sv1;
-         float nx1 = cv1*cu;
-         float ny1 = cv1*su;
-         float nz1 = sv1;
-
-         // two rows alternating for strip
-         glNormal3f(nx0,ny0,nz0); glVertex3f(x0,y0,z0);
-         glNormal3f(nx1,ny1,nz1); glVertex3f(x1,y1,z1);
+         float* p = g.xyz + 6*(j*(rings + 1) + i);
+         p[0] = (R + r*cv) * cu;
+         p[1] = (R + r*cv) * su;
+         p[2] = r*sv;
+         p[3] = cv*cu;
+         p[4] = cv*su;
+         p[5] = sv;
       }
-      glEnd();
    }
+   return g;
 }
 
 /*
- *  Emissive sphere (simple lat-long using Vertex helper)
+ *  Cached torus with the sweep and segments clamped
+ */
+static const Mesh* torusMesh(float R, float r, float sweepDeg, int rings, int sides)
+{
+   if (sweepDeg < 0) sweepDeg = 0;
+   if (sweepDeg > 360) sweepDeg = 360;
+   if (rings < 3) rings = 3;
+   if (sides < 3) sides = 3;
+
+   const float key[6] = {1, R, r, sweepDeg, rings, sides};
+   Mesh* m = meshFind(key);
+   if (!m)
+   {
+      Geom g = torusGeom(R, r, sweepDeg, rings, sides);
+      m = meshStore(key, &g);
+   }
+   return m;
+}
+
+/*
+ *  Draw torus with rings and sides halved up to twice when it is small on screen
+ */
+static void torus(float R, float r, float sweepDeg, int rings, int sides)
+{
+   if (rings > 0) rings >>= tessLevel(ProjectedRadius(StackTop(&mv), R + r), sweepDeg*(float)M_PI/180.0f / rings);
+   if (sides > 0) sides >>= tessLevel(ProjectedRadius(StackTop(&mv), r), 2*(float)M_PI / sides);
+   meshDraw(torusMesh(R, r, sweepDeg, rings, sides));
+}
+
+/*
+ *  Emissive sphere (simple lat-long using the cached sphere)
  *  intensity = emission amount [0..1]
  */
 static void emissiveBall(double x,double y,double z,double r,float intensity,const Color* color)
@@ -352,27 +641,30 @@ static void emissiveBall(double x,double y,double z,double r,float intensity,con
    float Emiss[] = {intensity*C->r,intensity*C->g,intensity*C->b,1.0f};
    float Black[] = {0.0f,0.0f,0.0f,1.0f};
 
-   glPushMatrix();
-   glTranslated(x,y,z);
-   glScaled(r,r,r);
+   StackPush(&mv);
+   StackTranslate(&mv,x,y,z);
+   StackScale(&mv,r,r,r);
+   Mat4Load(StackTop(&mv));
 
-   glMaterialfv(GL_FRONT,GL_EMISSION,Emiss);
+   MaterialSet(GL_FRONT,GL_EMISSION,Emiss);
    glColor3f(C->r,C->g,C->b);
-   for (int ph=-90;ph<90;ph+=inc)
-   {
-      glBegin(GL_QUAD_STRIP);
-      for (int th=0;th<=360;th+=2*inc)
-      {
-         Vertex(th,ph);
-         Vertex(th,ph+inc);
-      }
-      glEnd();
-   }
-   glMaterialfv(GL_FRONT,GL_EMISSION,Black);
+   meshDraw(sphereMesh(sphereStep()));
+   MaterialSet(GL_FRONT,GL_EMISSION,Black);
 
-   glPopMatrix();
+   StackPop(&mv);
+   Mat4Load(StackTop(&mv));
 }
 
+// Street lamp dimensions
+static const float poleH   = 2.2f;
+static const float poleW   = 0.06f;
+static const float RArm    = 0.6f;
+static const float rArm    = 0.05f;
+static const float sweep   = 120.0f;  // degrees
+static const int   rings   = 32;
+static const int   sides   = 16;
+static const float bulbR   = 0.09f;
+
 /*
  *  Street lamp composed of:
  *   - vertical pole (box quads)
@@ -383,83 +675,364 @@ static void streetLamp(double x,double y,double z,
                        const Material* metalMat,
                        const Color* bulbColor)
 {
-   // Parameters
-   const float poleH   = 2.2f;
-   const float poleW   = 0.06f;
-   const float RArm    = 0.6f;
-   const float rArm    = 0.05f;
-   const float sweep   = 120.0f;  // degrees
-   const int   rings   = 32;
-   const int   sides   = 16;
-   const float bulbR   = 0.09f;
-
-   glPushMatrix();
-   glTranslated(x,y,z);
+   StackPush(&mv);
+   StackTranslate(&mv,x,y,z);
+   Mat4Load(StackTop(&mv));
 
    // Apply metal material
    const Material* MM = metalMat ? metalMat : &METAL_DFLT;
    float A[4] = {MM->ambient.r ,MM->ambient.g ,MM->ambient.b ,1.0f};
    float D[4] = {MM->diffuse.r ,MM->diffuse.g ,MM->diffuse.b ,1.0f};
    float S[4] = {MM->specular.r,MM->specular.g,MM->specular.b,1.0f};
-   glMaterialfv(GL_FRONT_AND_BACK,GL_AMBIENT ,A);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_DIFFUSE ,D);
-   glMaterialfv(GL_FRONT_AND_BACK,GL_SPECULAR,S);
-   glMaterialf (GL_FRONT_AND_BACK,GL_SHININESS,MM->shininess);
+   MaterialSet (GL_FRONT_AND_BACK,GL_AMBIENT ,A);
+   MaterialSet (GL_FRONT_AND_BACK,GL_DIFFUSE ,D);
+   MaterialSet (GL_FRONT_AND_BACK,GL_SPECULAR,S);
+   MaterialSetf(GL_FRONT_AND_BACK,GL_SHININESS,MM->shininess);
 
    // Pole (dark gray) - raise so base sits on ground (y=0)
-   glPushMatrix();
-   glTranslated(0.0, poleH, 0.0);
+   StackPush(&mv);
+   StackTranslate(&mv, 0.0f, poleH, 0.0f);
+   Mat4Load(StackTop(&mv));
    boxQuadsLit(poleW, poleH, poleW, MM->diffuse.r, MM->diffuse.g, MM->diffuse.b);
-   glPopMatrix();
+   StackPop(&mv);
 
    // Arm at top of pole; attach torus circular face (u=0 ring) to the top square face of the pole.
    // Place ring plane at y = 2*poleH and shift by -RArm in X so the ring center sits above the pole center.
-   glPushMatrix();
-   glTranslated(0.0, 2.0f*poleH, 0.0);
-   glTranslatef(-RArm, 0.0f, 0.0f);
+   StackPush(&mv);
+   StackTranslate(&mv, -RArm, 2.0f*poleH, 0.0f);
+   Mat4Load(StackTop(&mv));
    glColor3f(MM->diffuse.r, MM->diffuse.g, MM->diffuse.b);
    torus(RArm, rArm, sweep, rings, sides);
-   glPopMatrix();
 
    // Bulb at arc tip in the same local frame: translate to tip and draw
-   glPushMatrix();
-   glTranslated(0.0, 2.0f*poleH, 0.0);
-   glTranslatef(-RArm, 0.0f, 0.0f);
    {
      double uRad = sweep * M_PI/180.0;
-     glTranslatef((RArm + rArm)*cos(uRad), (RArm + rArm)*sin(uRad), 0.0f);
      const Color* BC = &AMBER_DARK;
      float emiss = 0.0f; // non-emissive bulb
-     emissiveBall(0.0,0.0,0.0, bulbR, emiss, BC);
+     emissiveBall((RArm + rArm)*cos(uRad), (RArm + rArm)*sin(uRad), 0.0, bulbR, emiss, BC);
    }
-   glPopMatrix();
+   StackPop(&mv);
 
-   glPopMatrix();
+   StackPop(&mv);
+   Mat4Load(StackTop(&mv));
+}
+
+/*
+ *  Check for instanced arrays
+ *  1 = OpenGL 3.3, 2 = only the ARB extensions, 0 = none
+ */
+static int HasInstancing()
+{
+   static int inst=-1;
+   if (inst>=0) return inst;
+   inst = 0;
+#ifdef GL_VERSION_3_3
+   const char* ver = (const char*)glGetString(GL_VERSION);
+   const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+   if (ver && atof(ver)>=3.3)
+      inst = 1;
+   else if (ext && strstr(ext,"GL_ARB_instanced_arrays") && strstr(ext,"GL_ARB_draw_instanced"))
+      inst = 2;
+#endif
+   return inst;
+}
+
+#ifdef GL_VERSION_3_3
+/*
+ *  Instanced forest
+ *  Each kind of object is one mesh with position, normal and color per
+ *  vertex plus a buffer with the place (x,y,z,scale) and tint (r,g,b,yaw)
+ *  of every instance, so each kind is one glDrawElementsInstanced call
+ *  however many objects there are.  The shader lights every vertex with
+ *  the ambient and diffuse terms of light 0 and the vertex color times
+ *  the tint as the material.
+ */
+typedef struct {
+   unsigned int vbo,ibo;  //  Mesh buffers
+   int nv,nidx;           //  Vertices and indices in the mesh
+   float* v;              //  Vertices while building (position, normal, color)
+   unsigned short* idx;   //  Indices while building
+   unsigned int ins;      //  Instance buffer
+   int n;                 //  Instances
+} Batch;
+static Batch batch[3];           //  Trees, rocks and lamps
+static unsigned int instProg=0;  //  Instancing shader
+static int planted=-1;           //  Objects in the instance buffers
+
+static const char* instVert =
+   "#version 120\n"
+   "attribute vec3 Vertex;\n"
+   "attribute vec3 Normal;\n"
+   "attribute vec3 Color;\n"
+   "attribute vec4 Place;\n"
+   "attribute vec4 Tint;\n"
+   "uniform bool Lit;\n"
+   "varying vec3 col;\n"
+   "void main()\n"
+   "{\n"
+   "   //  Turn by yaw about y, scale and move into place\n"
+   "   float c = cos(radians(Tint.a));\n"
+   "   float s = sin(radians(Tint.a));\n"
+   "   mat3 yaw = mat3(c,0,-s , 0,1,0 , s,0,c);\n"
+   "   vec4 P = gl_ModelViewMatrix*vec4(Place.w*(yaw*Vertex)+Place.xyz,1);\n"
+   "   col = Color*Tint.rgb;\n"
+   "   if (Lit)\n"
+   "   {\n"
+   "      vec3 N = normalize(gl_NormalMatrix*(yaw*Normal));\n"
+   "      vec3 L = normalize(gl_LightSource[0].position.xyz-P.xyz*gl_LightSource[0].position.w);\n"
+   "      col *= gl_LightModel.ambient.rgb+gl_LightSource[0].ambient.rgb\n"
+   "           + max(dot(N,L),0.0)*gl_LightSource[0].diffuse.rgb;\n"
+   "   }\n"
+   "   gl_Position = gl_ProjectionMatrix*P;\n"
+   "}\n";
+static const char* instFrag =
+   "#version 120\n"
+   "varying vec3 col;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_FragColor = vec4(col,1);\n"
+   "}\n";
+static const char* instAttrib[] = {"Vertex","Normal","Color","Place","Tint",NULL};
+
+/*
+ *  Add mesh g scaled by (sx,sy,sz), moved to (x,y,z) and colored c
+ *  and release the mesh
+ */
+static void batchAdd(Batch* b,Geom g,float x,float y,float z,float sx,float sy,float sz,Color c)
+{
+   int nf = g.normals ? 6 : 3;
+   b->v = (float*)MemRealloc(MEM_TEMP,b->v,9*(b->nv+g.nv)*sizeof(float));
+   b->idx = (unsigned short*)MemRealloc(MEM_TEMP,b->idx,(b->nidx+g.nidx)*sizeof(unsigned short));
+   if (!b->v || !b->idx) Fatal("Cannot allocate instanced mesh\n");
+   if (b->nv+g.nv>65536) Fatal("Instanced mesh too large\n");
+   //  Transform positions and normals
+   for (int k=0;k<g.nv;k++)
+   {
+      const float* p = g.xyz+nf*k;
+      const float* N = g.normals ? p+3 : p;
+      float* q = b->v+9*(b->nv+k);
+      float nx = N[0]/sx, ny = N[1]/sy, nz = N[2]/sz;
+      float l = sqrt(nx*nx+ny*ny+nz*nz);
+      if (l>0) {nx /= l; ny /= l; nz /= l;}
+      float T[9] = {sx*p[0]+x,sy*p[1]+y,sz*p[2]+z , nx,ny,nz , c.r,c.g,c.b};
+      memcpy(q,T,sizeof(T));
+   }
+   for (int k=0;k<g.nidx;k++)
+      b->idx[b->nidx+k] = b->nv+g.idx[k];
+   b->nv += g.nv;
+   b->nidx += g.nidx;
+   geomFree(&g);
+}
+
+/*
+ *  Copy the mesh built with batchAdd to buffer objects
+ */
+static void batchUpload(Batch* b)
+{
+   glGenBuffers(1,&b->vbo);
+   glGenBuffers(1,&b->ibo);
+   glGenBuffers(1,&b->ins);
+   glBindBuffer(GL_ARRAY_BUFFER,b->vbo);
+   glBufferData(GL_ARRAY_BUFFER,9*b->nv*sizeof(float),b->v,GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,b->ibo);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER,b->nidx*sizeof(unsigned short),b->idx,GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+   MemGL(MEM_BUFOBJ,b->vbo,MEM_MESH,9*b->nv*sizeof(float));
+   MemGL(MEM_BUFOBJ,b->ibo,MEM_MESH,b->nidx*sizeof(unsigned short));
+   MemFree(b->v);
+   MemFree(b->idx);
+   b->v = NULL;
+   b->idx = NULL;
+}
+
+/*
+ *  Unit box with per-face normals (same faces as boxQuadsLit)
+ */
+static Geom boxGeom()
+{
+   //  Corners of each face and its normal
+   static const float face[6][5][3] = {
+      {{-1,-1, 1},{+1,-1, 1},{+1,+1, 1},{-1,+1, 1},{ 0, 0, 1}},
+      {{+1,-1,-1},{-1,-1,-1},{-1,+1,-1},{+1,+1,-1},{ 0, 0,-1}},
+      {{+1,-1,+1},{+1,-1,-1},{+1,+1,-1},{+1,+1,+1},{+1, 0, 0}},
+      {{-1,-1,-1},{-1,-1,+1},{-1,+1,+1},{-1,+1,-1},{-1, 0, 0}},
+      {{-1,+1,+1},{+1,+1,+1},{+1,+1,-1},{-1,+1,-1},{ 0,+1, 0}},
+      {{-1,-1,-1},{+1,-1,-1},{+1,-1,+1},{-1,-1,+1},{ 0,-1, 0}},
+   };
+   Geom g = geomAlloc(24,1,36);
+   for (int f=0;f<6;f++)
+   {
+      for (int k=0;k<4;k++)
+      {
+         memcpy(g.xyz+6*(4*f+k),face[f][k],3*sizeof(float));
+         memcpy(g.xyz+6*(4*f+k)+3,face[f][4],3*sizeof(float));
+      }
+      unsigned short t[6] = {4*f,4*f+1,4*f+2 , 4*f,4*f+2,4*f+3};
+      memcpy(g.idx+6*f,t,sizeof(t));
+   }
+   return g;
+}
+
+/*
+ *  Build one mesh per kind of object in the shape of treeLit (height 2,
+ *  canopy radius 1), rockLit (scale 1) and streetLamp
+ */
+static void forestInit()
+{
+   instProg = CreateShaderProg(instVert,instFrag,instAttrib);
+   //  Tree
+   for (int k=0;k<4;k++)
+   {
+      const float* B = treeBox[k];
+      Color c = k ? (Color){B[3]*CANOPY_DFLT.r,B[3]*CANOPY_DFLT.g,B[3]*CANOPY_DFLT.b} : TRUNK_COLOR;
+      batchAdd(batch+0,boxGeom(),0,2*B[0],0,B[1],2*B[2],B[1],c);
+   }
+   //  Rock
+   batchAdd(batch+1,rockGeom(),0,0,0,1,1,1,ROCK_DFLT.diffuse);
+   //  Street lamp with fewer segments since there are many of them
+   float u = sweep*M_PI/180;
+   batchAdd(batch+2,boxGeom(),0,poleH,0,poleW,poleH,poleW,METAL_DFLT.diffuse);
+   batchAdd(batch+2,torusGeom(RArm,rArm,sweep,rings/4,sides/2),-RArm,2*poleH,0,1,1,1,METAL_DFLT.diffuse);
+   batchAdd(batch+2,sphereGeom(30),-RArm+(RArm+rArm)*cos(u),2*poleH+(RArm+rArm)*sin(u),0,bulbR,bulbR,bulbR,AMBER_DARK);
+   for (int k=0;k<3;k++)
+      batchUpload(batch+k);
+}
+
+/*
+ *  Random number from min to max
+ */
+static float frand(unsigned int* seed,float min,float max)
+{
+   *seed = *seed*1103515245u+12345u;
+   return min + (max-min)*(*seed>>8)/16777216.0f;
+}
+
+/*
+ *  Scatter n trees, rocks and lamps on a square grid around the origin
+ */
+static void forestPlant(int n)
+{
+   float* inst[3];
+   int m[3] = {0,0,0};
+   for (int k=0;k<3;k++)
+   {
+      inst[k] = (float*)MemAlloc(MEM_TEMP,8*n*sizeof(float));
+      if (!inst[k]) Fatal("Cannot allocate %d instances\n",n);
+   }
+   unsigned int seed=1;
+   int side = ceil(sqrt(n));
+   for (int i=0;i<n;i++)
+   {
+      //  Six trees, three rocks and a lamp out of ten
+      float pick = frand(&seed,0,1);
+      int k = pick<0.6 ? 0 : pick<0.9 ? 1 : 2;
+      float x = 3*(i%side-0.5*(side-1)) + frand(&seed,-1,1);
+      float z = 3*(i/side-0.5*(side-1)) + frand(&seed,-1,1);
+      float s = k==1 ? frand(&seed,0.3,0.8) : frand(&seed,0.8,1.2);
+      float t = frand(&seed,0.85,1.15);
+      float T[8] = {x,0,z,s , t*frand(&seed,0.9,1.1),t*frand(&seed,0.9,1.1),t*frand(&seed,0.9,1.1),frand(&seed,0,360)};
+      memcpy(inst[k]+8*m[k]++,T,sizeof(T));
+   }
+   for (int k=0;k<3;k++)
+   {
+      glBindBuffer(GL_ARRAY_BUFFER,batch[k].ins);
+      glBufferData(GL_ARRAY_BUFFER,8*m[k]*sizeof(float),inst[k],GL_STATIC_DRAW);
+      MemGL(MEM_BUFOBJ,batch[k].ins,MEM_MESH,8*m[k]*sizeof(float));
+      batch[k].n = m[k];
+      MemFree(inst[k]);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   planted = n;
+}
+
+/*
+ *  Attribute divisor from the core or ARB entry point
+ */
+static void vertexAttribDivisor(int k,int n)
+{
+   if (HasInstancing()==2)
+      glVertexAttribDivisorARB(k,n);
+   else
+      glVertexAttribDivisor(k,n);
+}
+
+/*
+ *  Draw every instance of a kind of object with one call
+ */
+static void batchDraw(const Batch* b)
+{
+   glBindBuffer(GL_ARRAY_BUFFER,b->vbo);
+   for (int k=0;k<3;k++)
+   {
+      glEnableVertexAttribArray(k);
+      glVertexAttribPointer(k,3,GL_FLOAT,GL_FALSE,9*sizeof(float),(void*)(3*k*sizeof(float)));
+   }
+   glBindBuffer(GL_ARRAY_BUFFER,b->ins);
+   for (int k=3;k<5;k++)
+   {
+      glEnableVertexAttribArray(k);
+      glVertexAttribPointer(k,4,GL_FLOAT,GL_FALSE,8*sizeof(float),(void*)(4*(k-3)*sizeof(float)));
+      vertexAttribDivisor(k,1);
+   }
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,b->ibo);
+   if (HasInstancing()==2)
+      glDrawElementsInstancedARB(GL_TRIANGLES,b->nidx,GL_UNSIGNED_SHORT,(void*)0,b->n);
+   else
+      glDrawElementsInstanced(GL_TRIANGLES,b->nidx,GL_UNSIGNED_SHORT,(void*)0,b->n);
+   GlDrawCount(GL_TRIANGLES,b->nidx*b->n);
+   for (int k=0;k<5;k++)
+   {
+      vertexAttribDivisor(k,0);
+      glDisableVertexAttribArray(k);
+   }
+   glBindBuffer(GL_ARRAY_BUFFER,0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,0);
+}
+
+#endif
+
+/*
+ *  Draw the instanced forest (0 if instancing is not available)
+ */
+static int forestDraw()
+{
+   if (!HasInstancing()) return 0;
+#ifdef GL_VERSION_3_3
+   if (!instProg) forestInit();
+   if (planted!=forest) forestPlant(forest);
+   glUseProgram(instProg);
+   glUniform1i(glGetUniformLocation(instProg,"Lit"),light);
+   for (int k=0;k<3;k++)
+      batchDraw(batch+k);
+   glUseProgram(0);
+#endif
+   return 1;
 }
 
 void display()
 {
+   TraceScope("display");
+   //  Enforce texture memory budget
+   TexFrame();
    //  Erase the window and the depth buffer
    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
    //  Enable Z-buffering in OpenGL
    glEnable(GL_DEPTH_TEST);
 
-   //  Undo previous transformations
-   glLoadIdentity();
    //  Perspective - set eye position
+   StackInit(&mv);
    if (mode)
    {
       double Ex = -2*dim*Sin(th)*Cos(ph);
       double Ey = +2*dim        *Sin(ph);
       double Ez = +2*dim*Cos(th)*Cos(ph);
-      gluLookAt(Ex,Ey,Ez , 0,0,0 , 0,Cos(ph),0);
+      StackLoad(&mv,Mat4LookAt(Ex,Ey,Ez , 0,0,0 , 0,Cos(ph),0));
    }
    //  Orthogonal - set world orientation
    else
-   {
-      glRotatef(ph,1,0,0);
-      glRotatef(th,0,1,0);
-   }
+      StackLoad(&mv,Mat4Rotate(Mat4Rotate(Mat4Identity(),ph,1,0,0),th,0,1,0));
+   Mat4Load(StackTop(&mv));
 
    //  Flat or smooth shading
    glShadeModel(smooth ? GL_SMOOTH : GL_FLAT);
@@ -497,24 +1070,69 @@ void display()
       glDisable(GL_LIGHTING);
 
    //  Draw by selection
+   GpuBegin("scene");
    switch (obj)
    {
       // scene with rocks, trees, and street lamps
       case 0:
       {
+         //  Trees (x,z,height,radius), rocks (x,z,scale) and street lamps (x,z)
+         static const double tree[3][4] = {{-2.2,-1.0,2.2,1.2},{2.4,1.1,2.0,1.0},{0.0,2.6,1.8,0.9}};
+         static const double rock[3][3] = {{-1.0,0.0,0.7},{1.2,-1.4,0.6},{0.6,1.5,0.5}};
+         static const double lamp[2][2] = {{-3.6,-0.8},{3.6,0.8}};
+         //  Bounding boxes in the same order
+         float xmin[8],ymin[8],zmin[8],xmax[8],ymax[8],zmax[8];
+         unsigned char vis[8];
+         int m=0;
+         for (int k=0;k<3;k++,m++)
+         {
+            const double* t = tree[k];
+            xmin[m] = t[0]-t[3]; ymin[m] = -0.2*t[2]; zmin[m] = t[1]-t[3];
+            xmax[m] = t[0]+t[3]; ymax[m] =  1.1*t[2]; zmax[m] = t[1]+t[3];
+         }
+         for (int k=0;k<3;k++,m++)
+         {
+            const double* r = rock[k];
+            xmin[m] = r[0]-1.25*r[2]; ymin[m] = -0.6*r[2]; zmin[m] = r[1]-1.25*r[2];
+            xmax[m] = r[0]+1.25*r[2]; ymax[m] =  0.7*r[2]; zmax[m] = r[1]+1.25*r[2];
+         }
+         for (int k=0;k<2;k++,m++)
+         {
+            const double* l = lamp[k];
+            xmin[m] = l[0]-1.3; ymin[m] = 0.0; zmin[m] = l[1]-0.1;
+            xmax[m] = l[0]+0.1; ymax[m] = 5.1; zmax[m] = l[1]+0.1;
+         }
+         //  Skip objects outside the view
+         frustum_t f = FrustumGL();
+         BoxesVisible(&f,m,xmin,ymin,zmin,xmax,ymax,zmax,vis);
+         m = 0;
+
+         // Ground
+         if (ground)
+         {
+            GpuBegin("ground");
+            glColor3f(1,1,1);
+            DrawTiled(ground,-8,-8,8,8,0);
+            GpuEnd();
+         }
+
          // Trees
-         treeLit(-2.2, 0.0, -1.0, 2.2, 1.2, &TRUNK_DFLT, &CANOPY_DFLT);
-         treeLit( 2.4, 0.0,  1.1, 2.0, 1.0, &TRUNK_DFLT, &CANOPY_DFLT);
-         treeLit( 0.0, 0.0,  2.6, 1.8, 0.9, &TRUNK_DFLT, &CANOPY_DFLT);
+         GpuBegin("trees");
+         for (int k=0;k<3;k++)
+            if (vis[m++]) treeLit(tree[k][0],0.0,tree[k][1],tree[k][2],tree[k][3],&TRUNK_DFLT,&CANOPY_DFLT);
+         GpuEnd();
 
          // Rocks
-         rockLit(-1.0, 0.0,  0.0, 0.7, &ROCK_DFLT);
-         rockLit( 1.2, 0.0, -1.4, 0.6, &ROCK_DFLT);
-         rockLit( 0.6, 0.0,  1.5, 0.5, &ROCK_DFLT);
+         GpuBegin("rocks");
+         for (int k=0;k<3;k++)
+            if (vis[m++]) rockLit(rock[k][0],0.0,rock[k][1],rock[k][2],&ROCK_DFLT);
+         GpuEnd();
 
          // Street lamps
-         streetLamp(-3.6, 0.0, -0.8, &METAL_DFLT, &BULB_DFLT);
-         streetLamp( 3.6, 0.0,  0.8, &METAL_DFLT, &BULB_DFLT);
+         GpuBegin("lamps");
+         for (int k=0;k<2;k++)
+            if (vis[m++]) streetLamp(lamp[k][0],0.0,lamp[k][1],&METAL_DFLT,&BULB_DFLT);
+         GpuEnd();
          break;
       }
       // solo rock
@@ -529,7 +1147,14 @@ void display()
       case 3:
          streetLamp(0.0,0.0,0.0, &METAL_DFLT, &BULB_DFLT);
          break;
+      // instanced forest
+      case 4:
+         GpuBegin("forest");
+         forestDraw();
+         GpuEnd();
+         break;
    }
+   GpuEnd();
 
    //  Draw axes - no lighting from here on
    glDisable(GL_LIGHTING);
@@ -554,22 +1179,44 @@ void display()
       Print("Z");
    }
 
-   //  Display parameters
-   glWindowPos2i(5,5);
-   Print("Angle=%d,%d  Dim=%.1f FOV=%d Projection=%s Light=%s",
+   //  Display parameters (redrawn only when they change)
+   HudLine(0,5,5,"Angle=%d,%d  Dim=%.1f FOV=%d Projection=%s Light=%s",
      th,ph,dim,fov,mode?"Perpective":"Orthogonal",light?"On":"Off");
    if (light)
    {
-      glWindowPos2i(5,45);
-      Print("Model=%s LocalViewer=%s Distance=%d Elevation=%.1f",smooth?"Smooth":"Flat",local?"On":"Off",distance,ylight);
-      glWindowPos2i(5,25);
-      Print("Ambient=%d", ambient);
+      HudLine(1,5,45,"Model=%s LocalViewer=%s Distance=%d Elevation=%.1f",smooth?"Smooth":"Flat",local?"On":"Off",distance,ylight);
+      HudLine(2,5,25,"Ambient=%d", ambient);
+   }
+   //  Texture memory
+   size_t texres,texbud;
+   TexMemory(&texres,&texbud);
+   if (texbud)
+      HudLine(3,5,65,"Texture=%.1f/%.1fMB",texres/1048576.0,texbud/1048576.0);
+   else
+      HudLine(3,5,65,"Texture=%.1fMB",texres/1048576.0);
+   //  Forest mode is skipped without instancing (the overlay starts after this line)
+   if (obj==4 && !HasInstancing())
+   {
+      int vp[4];
+      glGetIntegerv(GL_VIEWPORT,vp);
+      HudLine(4,5,vp[3]-25,"Instanced forest needs OpenGL 3.3");
    }
 
+   //  Performance overlay
+   GpuFrame();
+   PerfHud(5,5,85);
+   //  Draw all text at once
+   HudDraw();
    //  Render the scene and make it visible
    ErrCheck("display");
    glFlush();
    glutSwapBuffers();
+   //  Time frame and advance camera path
+   PathFrame();
+   TraceFrame();
+   GlStatFrame();
+   StartupFrame();
+   MaterialFrame();
 }
 
 /*
@@ -577,8 +1224,9 @@ void display()
  */
 void idle()
 {
-   //  Elapsed time in seconds
-   double t = glutGet(GLUT_ELAPSED_TIME)/1000.0;
+   TraceScope("idle");
+   //  Elapsed time in seconds (simulated during camera path playback)
+   double t = PathTime();
    zh = fmod(90*t,360.0);
    //  Tell GLUT it is necessary to redisplay the scene
    glutPostRedisplay();
@@ -616,6 +1264,8 @@ void special(int key,int x,int y)
    ph %= 360;
    //  Update projection
    Project(mode?fov:0,asp,dim);
+   //  Record camera path
+   PathKey(1,key);
    //  Tell GLUT it is necessary to redisplay the scene
    glutPostRedisplay();
 }
@@ -634,6 +1284,12 @@ void key(unsigned char ch,int x,int y)
    //  Toggle axes
    else if (ch == 'x' || ch == 'X')
       axes = 1-axes;
+   //  Toggle procedural textures
+   else if (ch == 't' || ch == 'T')
+      textures = 1-textures;
+   //  Cycle performance overlay pages
+   else if (ch == 'g' || ch == 'G')
+      PerfToggle();
    //  Toggle lighting
    else if (ch == 'l' || ch == 'L')
       light = 1-light;
@@ -702,15 +1358,22 @@ void key(unsigned char ch,int x,int y)
    }
    //  Switch scene/object
    else if (ch == 'o')
-      obj = (obj+1)%4;
+      obj = (obj+1)%5;
    else if (ch == 'O')
-      obj = (obj+3)%4;
+      obj = (obj+4)%5;
+   //  Size of the instanced forest
+   else if (ch == 'c' && forest>50)
+      forest /= 10;
+   else if (ch == 'C' && forest<500000)
+      forest *= 10;
    //  Translate shininess power to value (-1 => 0)
    shiny = shininess<0 ? 0 : pow(2.0,shininess);
    //  Reproject
    Project(mode?fov:0,asp,dim);
    //  Animate if requested
    glutIdleFunc(move?idle:NULL);
+   //  Record camera path
+   PathKey(0,ch);
    //  Tell GLUT it is necessary to redisplay the scene
    glutPostRedisplay();
 }
@@ -728,53 +1391,66 @@ void reshape(int width,int height)
    Project(mode?fov:0,asp,dim);
 }
 
-/*
- *  Random numbers from min to max to the power p
- */
-static float frand(float min,float max,float p)
-{
-   return pow(rand()/(float)RAND_MAX,p)*(max-min)+min;
-}
-
-/*
- * Initialize icosasphere locations
- */
-void Init()
-{
-   for (int i=0;i<n;i++)
-   {
-      float th = frand(0,360,1);
-      float ph = frand(-90,+90,1);
-      float r  = frand(0.1,0.7,3);
-      is[i].x = r*Sin(th)*Cos(ph);
-      is[i].y = r*Cos(th)*Cos(ph);
-      is[i].z = r*Sin(ph) + 1.0;
-   }
-}
-
 /*
  *  Start up GLUT and tell it what to do
  */
 int main(int argc,char* argv[])
 {
-   //  Initialize
-   Init();
+   //  Startup timeline
+   StartupInit(argc,argv);
+   //  Instanced forest size and ground image
+   const char* groundfile=NULL;
+   for (int k=1;k+1<argc;k++)
+      if (!strcmp(argv[k],"-forest"))
+      {
+         forest = atoi(argv[++k]);
+         if (forest<1) Fatal("Invalid forest size %s\n",argv[k]);
+      }
+      else if (!strcmp(argv[k],"-ground"))
+         groundfile = argv[++k];
    //  Initialize GLUT
    glutInit(&argc,argv);
+   StartupMark("glutInit");
    //  Request double buffered, true color window with Z buffering at 600x600
    glutInitDisplayMode(GLUT_RGB | GLUT_DEPTH | GLUT_DOUBLE);
    glutInitWindowSize(900,600);
    glutCreateWindow("Lighting");
+   StartupMark("window");
 #ifdef USEGLEW
    //  Initialize GLEW
    if (glewInit()!=GLEW_OK) Fatal("Error initializing GLEW\n");
+   StartupMark("glew");
 #endif
+   //  Report OpenGL errors (--gl-debug for full checking)
+   ErrCheckInit(argc,argv);
+   //  GPU profiler
+   GpuInit(argc,argv);
+   //  CPU trace (built with -DTRACE)
+   TraceInit(argc,argv);
+   //  GL call counts (built with -DGLSTATS)
+   GlStatInit(argc,argv);
+   StartupMark("tools");
+   //  Tiled ground
+   if (groundfile)
+   {
+      ground = LoadTiledBMP(groundfile);
+      StartupMark("ground");
+   }
    //  Set callbacks
    glutDisplayFunc(display);
    glutReshapeFunc(reshape);
    glutSpecialFunc(special);
    glutKeyboardFunc(key);
    glutIdleFunc(idle);
+   //  Camera path recording and playback
+   PathInt(&th);
+   PathInt(&ph);
+   PathInt(&fov);
+   PathInt(&mode);
+   PathInt(&obj);
+   PathInt(&forest);
+   PathDouble(&dim);
+   PathArgs(argc,argv,key,special);
    //  Pass control to GLUT so it can interact with the user
    ErrCheck("init");
    glutMainLoop();
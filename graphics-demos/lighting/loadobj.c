@@ -8,6 +8,7 @@
 //  Materials are supported
 //  Textures must be BMP files
 //  Surfaces are not supported
+//  Draw the list with TexCallList so texture streaming sees its textures
 //
 //  WARNING:  This is a minimalist implementation of the OBJ file loader.  It
 //  will only correctly load a small subset of possible OBJ files.  It is
@@ -56,7 +57,7 @@ static char* readline(FILE* f)
       if (k>=linelen)
       {
          linelen += 8192;
-         line = (char*)realloc(line,linelen);
+         line = (char*)MemRealloc(MEM_TEMP,line,linelen);
          if (!line) Fatal("Out of memory in readline\n");
       }
       //  End of Line
@@ -131,7 +132,7 @@ static void readcoord(char* line,int n,float* x[],int* N,int* M)
    if (*N+n > *M)
    {
       *M += 8192;
-      *x = (float*)realloc(*x,(*M)*sizeof(float));
+      *x = (float*)MemRealloc(MEM_MESH,*x,(*M)*sizeof(float));
       if (!*x) Fatal("Cannot allocate memory\n");
    }
    //  Read n coordinates
@@ -164,9 +165,14 @@ static char* readstr(char* line,const char* skip)
 //
 static void LoadMaterial(const char* file)
 {
+   TraceScope("LoadMaterial");
    int k=-1;
    char* line;
    char* str;
+   //  Texture maps are loaded together once the file is read
+   int nmap=0;
+   int* mapk=NULL;
+   char** mapfile=NULL;
 
    //  Open file or return with warning on error
    FILE* f = fopen(file,"r");
@@ -185,9 +191,10 @@ static void LoadMaterial(const char* file)
          int l = strlen(str);
          //  Allocate memory for structure
          k = Nmtl++;
-         mtl = (mtl_t*)realloc(mtl,Nmtl*sizeof(mtl_t));
+         mtl = (mtl_t*)MemRealloc(MEM_MESH,mtl,Nmtl*sizeof(mtl_t));
+         if (!mtl) Fatal("Cannot allocate memory for material %s\n",str);
          //  Store name
-         mtl[k].name = (char*)malloc(l+1);
+         mtl[k].name = (char*)MemAlloc(MEM_MESH,l+1);
          if (!mtl[k].name) Fatal("Cannot allocate %d for name\n",l+1);
          strcpy(mtl[k].name,str);
          //  Initialize materials
@@ -219,10 +226,34 @@ static void LoadMaterial(const char* file)
       }
       //  Textures (must be BMP - will fail if not)
       else if ((str = readstr(line,"map_Kd")))
-         mtl[k].map = LoadTexBMP(str);
+      {
+         mapk = (int*)MemRealloc(MEM_TEMP,mapk,(nmap+1)*sizeof(int));
+         mapfile = (char**)MemRealloc(MEM_TEMP,mapfile,(nmap+1)*sizeof(char*));
+         if (!mapk || !mapfile) Fatal("Cannot allocate memory for texture maps\n");
+         mapfile[nmap] = (char*)MemAlloc(MEM_TEMP,strlen(str)+1);
+         if (!mapfile[nmap]) Fatal("Cannot allocate memory for texture name %s\n",str);
+         strcpy(mapfile[nmap],str);
+         mapk[nmap++] = k;
+      }
       //  Ignore line if we get here
    }
    fclose(f);
+
+   //  Decode all texture maps in parallel
+   if (nmap)
+   {
+      unsigned int* tex = (unsigned int*)MemAlloc(MEM_TEMP,nmap*sizeof(unsigned int));
+      if (!tex) Fatal("Cannot allocate memory for texture maps\n");
+      LoadTexBMPs(nmap,(const char**)mapfile,tex);
+      for (int i=0;i<nmap;i++)
+      {
+         mtl[mapk[i]].map = tex[i];
+         MemFree(mapfile[i]);
+      }
+      MemFree(tex);
+   }
+   MemFree(mapk);
+   MemFree(mapfile);
 }
 
 //
@@ -258,6 +289,7 @@ static void SetMaterial(const char* name)
 //
 int LoadOBJ(const char* file)
 {
+   TraceScope("LoadOBJ");
    int  Nv,Nn,Nt;  //  Number of vertex, normal and textures
    int  Mv,Mn,Mt;  //  Maximum vertex, normal and textures
    float* V;       //  Array of vertexes
@@ -265,6 +297,7 @@ int LoadOBJ(const char* file)
    float* T;       //  Array if textures coordinates
    char*  line;    //  Line pointer
    char*  str;     //  String pointer
+   size_t nvert=0; //  Vertexes drawn
 
    //  Open file
    FILE* f = fopen(file,"r");
@@ -274,6 +307,13 @@ int LoadOBJ(const char* file)
    mtl = NULL;
    Nmtl = 0;
 
+   //  Load materials first so their textures are created now rather than
+   //  compiled into the display list
+   while ((line = readline(f)))
+      if ((str = readstr(line,"mtllib")))
+         LoadMaterial(str);
+   rewind(f);
+
    //  Start new displaylist
    int list = glGenLists(1);
    glNewList(list,GL_COMPILE);
@@ -331,32 +371,45 @@ int LoadOBJ(const char* file)
             //  Draw vectors
             if (Kt) glTexCoord2fv(T+2*(Kt-1));
             if (Kn) glNormal3fv(N+3*(Kn-1));
-            if (Kv) glVertex3fv(V+3*(Kv-1));
+            if (Kv)
+            {
+               glVertex3fv(V+3*(Kv-1));
+               nvert++;
+            }
          }
          glEnd();
       }
       //  Use material
       else if ((str = readstr(line,"usemtl")))
          SetMaterial(str);
-      //  Load materials
-      else if ((str = readstr(line,"mtllib")))
-         LoadMaterial(str);
       //  Skip this line
    }
    fclose(f);
    //  Pop attributes (textures)
    glPopAttrib();
    glEndList();
+   //  Display lists have no size query so estimate it from the vertexes
+   //  (position, normal and texture coordinates as floats)
+   MemGL(MEM_LISTOBJ,list,MEM_MESH,nvert*8*sizeof(float));
+
+   //  Record textures for the texture manager
+   unsigned int* map = (unsigned int*)MemAlloc(MEM_TEMP,(Nmtl+1)*sizeof(unsigned int));
+   if (!map) Fatal("Cannot allocate memory for texture maps\n");
+   int nmap=0;
+   for (int k=0;k<Nmtl;k++)
+      if (mtl[k].map) map[nmap++] = mtl[k].map;
+   TexList(list,nmap,map);
+   MemFree(map);
 
    //  Free materials
    for (int k=0;k<Nmtl;k++)
-      free(mtl[k].name);
-   free(mtl);
+      MemFree(mtl[k].name);
+   MemFree(mtl);
 
    //  Free arrays
-   free(V);
-   free(T);
-   free(N);
+   MemFree(V);
+   MemFree(T);
+   MemFree(N);
 
    return list;
 }
@@ -5,96 +5,722 @@
 //
 //  Load texture from BMP file
 //
+//  Supported formats
+//    1, 4 and 8 bits per pixel with a color table (uncompressed, RLE4 or RLE8)
+//    16 and 32 bits per pixel with default masks or BI_BITFIELDS
+//    24 bits per pixel BGR
+//    32 bits per pixel BGRA (alpha is kept if any pixel sets it)
+//  RLE and uncompressed rows are decoded one row at a time straight into the
+//  image that is uploaded to OpenGL, so no copy of the file is held in memory
+//
+
+//  BMP compression types
+#define BI_RGB            0
+#define BI_RLE8           1
+#define BI_RLE4           2
+#define BI_BITFIELDS      3
+#define BI_ALPHABITFIELDS 6
+
+//  BMP decoder state
+typedef struct
+{
+   FILE* f;                    //  File pointer
+   const char* file;           //  File name (for messages)
+   int dx,dy;                  //  Image dimensions
+   int topdown;                //  Rows are stored top to bottom
+   int bpp;                    //  Bits per pixel
+   int k;                      //  Compression
+   int ncomp;                  //  Components per output pixel (3 or 4)
+   unsigned int mask[4];       //  Red, green, blue and alpha masks
+   int shift[4];               //  Mask shifts
+   unsigned int max[4];        //  Largest value of each masked field
+   unsigned char pal[256][3];  //  Color table (RGB)
+   unsigned char* raw;         //  Raw row buffer
+   int stride;                 //  Bytes per raw row (padded to 4 bytes)
+   int skip;                   //  RLE rows left blank by a delta or end of bitmap
+   int x;                      //  RLE column to resume at after a delta
+} bmp_t;
+
+//
+//  Little endian values from a byte buffer
+//
+static unsigned int U16(const unsigned char* p)
+{
+   return p[0] | p[1]<<8;
+}
+static unsigned int U32(const unsigned char* p)
+{
+   return p[0] | p[1]<<8 | p[2]<<16 | (unsigned int)p[3]<<24;
+}
 
 //
-//  Reverse n bytes
+//  Set mask and derive shift and field width
+//  Returns 0 if the set bits of the mask are not contiguous
 //
-static void Reverse(void* x,const int n)
+static int SetMask(bmp_t* bmp,int i,unsigned int mask)
 {
-   char* ch = (char*)x;
-   for (int k=0;k<n/2;k++)
+   bmp->mask[i]  = mask;
+   bmp->shift[i] = 0;
+   bmp->max[i]   = 0;
+   if (!mask) return 1;
+   while (!(mask&1))
    {
-      char tmp = ch[k];
-      ch[k] = ch[n-1-k];
-      ch[n-1-k] = tmp;
+      mask >>= 1;
+      bmp->shift[i]++;
    }
+   bmp->max[i] = mask;
+   return !(mask&(mask+1));
 }
 
 //
-//  Load texture from BMP file
+//  Scale masked field i of pixel p to 0-255
 //
-unsigned int LoadTexBMP(const char* file)
+static unsigned char Field(const bmp_t* bmp,int i,unsigned int p)
+{
+   unsigned int v = (p&bmp->mask[i]) >> bmp->shift[i];
+   if (!bmp->max[i]) return 0;
+   return bmp->max[i]==255 ? v : (v*255ull+bmp->max[i]/2)/bmp->max[i];
+}
+
+//
+//  Open BMP file and read headers
+//
+static void OpenBMP(bmp_t* bmp,const char* file)
 {
+   unsigned char hdr[14+124];  //  File header and largest info header
+   memset(hdr,0,sizeof(hdr));
+   memset(bmp,0,sizeof(bmp_t));
+   bmp->file = file;
    //  Open file
-   FILE* f = fopen(file,"rb");
-   if (!f) Fatal("Cannot open file %s\n",file);
+   bmp->f = fopen(file,"rb");
+   if (!bmp->f) Fatal("Cannot open file %s\n",file);
    //  Check image magic
-   unsigned short magic;
-   if (fread(&magic,2,1,f)!=1) Fatal("Cannot read magic from %s\n",file);
-   if (magic!=0x4D42 && magic!=0x424D) Fatal("Image magic not BMP in %s\n",file);
-   //  Read header
-   unsigned int dx,dy,off,k; // Image dimensions, offset and compression
-   unsigned short nbp,bpp;   // Planes and bits per pixel
-   if (fseek(f,8,SEEK_CUR) || fread(&off,4,1,f)!=1 ||
-       fseek(f,4,SEEK_CUR) || fread(&dx,4,1,f)!=1 || fread(&dy,4,1,f)!=1 ||
-       fread(&nbp,2,1,f)!=1 || fread(&bpp,2,1,f)!=1 || fread(&k,4,1,f)!=1)
-     Fatal("Cannot read header from %s\n",file);
-   //  Reverse bytes on big endian hardware (detected by backwards magic)
-   if (magic==0x424D)
-   {
-      Reverse(&off,4);
-      Reverse(&dx,4);
-      Reverse(&dy,4);
-      Reverse(&nbp,2);
-      Reverse(&bpp,2);
-      Reverse(&k,4);
+   if (fread(hdr,18,1,bmp->f)!=1) Fatal("Cannot read magic from %s\n",file);
+   if (hdr[0]!='B' || hdr[1]!='M') Fatal("Image magic not BMP in %s\n",file);
+   //  Read info header
+   unsigned int off = U32(hdr+10);
+   unsigned int len = U32(hdr+14);
+   if (len!=12 && (len<40 || len>124)) Fatal("%s unsupported BMP header size %d\n",file,len);
+   if (fread(hdr+18,len-4,1,bmp->f)!=1) Fatal("Cannot read header from %s\n",file);
+   unsigned int nbp,ncol=0;
+   int dy;
+   //  OS/2 core header
+   if (len==12)
+   {
+      bmp->dx  = U16(hdr+18);
+      dy       = (short)U16(hdr+20);
+      nbp      = U16(hdr+22);
+      bmp->bpp = U16(hdr+24);
+   }
+   //  Windows info header
+   else
+   {
+      bmp->dx  = (int)U32(hdr+18);
+      dy       = (int)U32(hdr+22);
+      nbp      = U16(hdr+26);
+      bmp->bpp = U16(hdr+28);
+      bmp->k   = U32(hdr+30);
+      ncol     = U32(hdr+46);
    }
+   //  Negative height means rows are stored top down
+   bmp->topdown = dy<0;
+   bmp->dy = abs(dy);
    //  Check image parameters
-   unsigned int max;
-   glGetIntegerv(GL_MAX_TEXTURE_SIZE,(int*)&max);
-   if (dx<1 || dx>max) Fatal("%s image width %d out of range 1-%d\n",file,dx,max);
-   if (dy<1 || dy>max) Fatal("%s image height %d out of range 1-%d\n",file,dy,max);
-   if (nbp!=1)  Fatal("%s bit planes is not 1: %d\n",file,nbp);
-   if (bpp!=24) Fatal("%s bits per pixel is not 24: %d\n",file,bpp);
-   if (k!=0)    Fatal("%s compressed files not supported\n",file);
+   if (nbp!=1) Fatal("%s bit planes is not 1: %d\n",file,nbp);
+   if (bmp->dx<1 || bmp->dy<1) Fatal("%s image size %dx%d invalid\n",file,bmp->dx,dy);
+   switch (bmp->k)
+   {
+      case BI_RGB:
+         if (bmp->bpp!=1 && bmp->bpp!=4 && bmp->bpp!=8 && bmp->bpp!=16 && bmp->bpp!=24 && bmp->bpp!=32)
+            Fatal("%s bits per pixel %d not supported\n",file,bmp->bpp);
+         break;
+      case BI_RLE8:
+         if (bmp->bpp!=8) Fatal("%s RLE8 requires 8 bits per pixel: %d\n",file,bmp->bpp);
+         if (bmp->topdown) Fatal("%s RLE images cannot be top down\n",file);
+         break;
+      case BI_RLE4:
+         if (bmp->bpp!=4) Fatal("%s RLE4 requires 4 bits per pixel: %d\n",file,bmp->bpp);
+         if (bmp->topdown) Fatal("%s RLE images cannot be top down\n",file);
+         break;
+      case BI_BITFIELDS:
+      case BI_ALPHABITFIELDS:
+         if (bmp->bpp!=16 && bmp->bpp!=32) Fatal("%s bitfields require 16 or 32 bits per pixel: %d\n",file,bmp->bpp);
+         break;
+      default:
+         Fatal("%s compression type %d not supported\n",file,bmp->k);
+   }
+
+   //  Masks for 16 and 32 bit images
+   if (bmp->bpp==16 || bmp->bpp==32)
+   {
+      //  Masks are part of V2+ headers or follow a plain info header
+      if (bmp->k!=BI_RGB)
+      {
+         int nmask = (bmp->k==BI_ALPHABITFIELDS || len>=56) ? 4 : 3;
+         if (len==40 && fread(hdr+54,4*nmask,1,bmp->f)!=1) Fatal("Cannot read bit masks from %s\n",file);
+         for (int i=0;i<nmask;i++)
+            if (!SetMask(bmp,i,U32(hdr+54+4*i))) Fatal("Invalid bit mask %08X in %s\n",U32(hdr+54+4*i),file);
+      }
+      //  Default 5-5-5 masks
+      else if (bmp->bpp==16)
+      {
+         SetMask(bmp,0,0x7C00);
+         SetMask(bmp,1,0x03E0);
+         SetMask(bmp,2,0x001F);
+      }
+      //  Default BGRA masks
+      else
+      {
+         SetMask(bmp,0,0x00FF0000);
+         SetMask(bmp,1,0x0000FF00);
+         SetMask(bmp,2,0x000000FF);
+         SetMask(bmp,3,0xFF000000);
+      }
+   }
+   bmp->ncomp = bmp->mask[3] ? 4 : 3;
+
+   //  Color table for palette images
+   if (bmp->bpp<=8)
+   {
+      int size = (len==12) ? 3 : 4;
+      if (ncol==0 || ncol>(1u<<bmp->bpp)) ncol = 1<<bmp->bpp;
+      for (unsigned int i=0;i<ncol;i++)
+      {
+         unsigned char bgr[4];
+         if (fread(bgr,size,1,bmp->f)!=1) Fatal("Cannot read color table from %s\n",file);
+         bmp->pal[i][0] = bgr[2];
+         bmp->pal[i][1] = bgr[1];
+         bmp->pal[i][2] = bgr[0];
+      }
+   }
+
+   //  Row buffer for formats that cannot be read in place
+   bmp->stride = 4*((bmp->dx*bmp->bpp+31)/32);
+   if ((bmp->k==BI_RGB && bmp->bpp<=16) || bmp->k==BI_BITFIELDS || bmp->k==BI_ALPHABITFIELDS)
+   {
+      bmp->raw = (unsigned char*)MemAlloc(MEM_TEMP,bmp->stride);
+      if (!bmp->raw) Fatal("Cannot allocate %d bytes of memory for image %s\n",bmp->stride,file);
+   }
+   //  Seek to image data
+   if (fseek(bmp->f,off,SEEK_SET)) Fatal("Error reading data from image %s\n",file);
+}
+
+//
+//  Set RLE pixel x of row to palette entry i
+//
+static void PutRLE(const bmp_t* bmp,unsigned char* row,int x,int i)
+{
+   if (x<bmp->dx) memcpy(row+3*x,bmp->pal[i],3);
+}
+
+//
+//  Decode one RLE row
+//  Pixels skipped by deltas or an early end of line are left black
+//
+static void ReadRLE(bmp_t* bmp,unsigned char* row)
+{
+   FILE* f = bmp->f;
+   memset(row,0,3*bmp->dx);
+   //  Row skipped by delta or end of bitmap
+   if (bmp->skip)
+   {
+      bmp->skip--;
+      return;
+   }
+   int x = bmp->x;
+   bmp->x = 0;
+   while (1)
+   {
+      int n = getc(f);
+      int c = getc(f);
+      if (c==EOF) Fatal("Premature end of RLE data in image %s\n",bmp->file);
+      //  Encoded run of n pixels
+      if (n)
+      {
+         for (int i=0;i<n;i++,x++)
+            PutRLE(bmp,row,x,bmp->bpp==8 ? c : (i&1) ? c&0xF : c>>4);
+      }
+      //  End of line
+      else if (c==0)
+         return;
+      //  End of bitmap - remaining rows are blank
+      else if (c==1)
+      {
+         bmp->skip = bmp->dy;
+         return;
+      }
+      //  Delta - move right and up
+      else if (c==2)
+      {
+         int ddx = getc(f);
+         int ddy = getc(f);
+         if (ddy==EOF) Fatal("Premature end of RLE data in image %s\n",bmp->file);
+         x += ddx;
+         if (ddy)
+         {
+            bmp->skip = ddy-1;
+            bmp->x = x;
+            return;
+         }
+      }
+      //  Absolute run of c pixels padded to a word
+      else
+      {
+         int len = (bmp->bpp==8) ? c : (c+1)/2;
+         int b = 0;
+         for (int i=0;i<c;i++,x++)
+         {
+            if (bmp->bpp==8 || !(i&1))
+               if ((b = getc(f))==EOF) Fatal("Premature end of RLE data in image %s\n",bmp->file);
+            PutRLE(bmp,row,x,bmp->bpp==8 ? b : (i&1) ? b&0xF : b>>4);
+         }
+         if (len&1) getc(f);
+      }
+   }
+}
+
+//
+//  Decode one row of the image into RGB or RGBA
+//  Returns true if any pixel has a non-zero alpha
+//
+static int ReadRow(bmp_t* bmp,unsigned char* row)
+{
+   int alpha=0;
+   //  Run length encoded
+   if (bmp->k==BI_RLE8 || bmp->k==BI_RLE4)
+      ReadRLE(bmp,row);
+   //  24 bit BGR - read in place and swap
+   else if (bmp->bpp==24)
+   {
+      if (fread(row,3*bmp->dx,1,bmp->f)!=1) Fatal("Error reading data from image %s\n",bmp->file);
+      for (int k=0;k<3*bmp->dx;k+=3)
+      {
+         unsigned char temp = row[k];
+         row[k]   = row[k+2];
+         row[k+2] = temp;
+      }
+      //  Skip row padding
+      unsigned char pad[4];
+      int npad = bmp->stride-3*bmp->dx;
+      if (npad && fread(pad,npad,1,bmp->f)!=1) Fatal("Error reading data from image %s\n",bmp->file);
+   }
+   //  32 bit BGRA - read in place and swap
+   else if (bmp->bpp==32 && bmp->k==BI_RGB)
+   {
+      if (fread(row,4*bmp->dx,1,bmp->f)!=1) Fatal("Error reading data from image %s\n",bmp->file);
+      for (int k=0;k<4*bmp->dx;k+=4)
+      {
+         unsigned char temp = row[k];
+         row[k]   = row[k+2];
+         row[k+2] = temp;
+         alpha |= row[k+3];
+      }
+   }
+   //  Everything else goes through the raw row buffer
+   else
+   {
+      if (fread(bmp->raw,bmp->stride,1,bmp->f)!=1) Fatal("Error reading data from image %s\n",bmp->file);
+      //  Palette
+      if (bmp->bpp<=8)
+      {
+         int m = (1<<bmp->bpp)-1;
+         for (int i=0;i<bmp->dx;i++)
+         {
+            int bit = i*bmp->bpp;
+            int c = (bmp->raw[bit/8] >> (8-bmp->bpp-bit%8)) & m;
+            memcpy(row+3*i,bmp->pal[c],3);
+         }
+      }
+      //  Bit fields
+      else
+      {
+         for (int i=0;i<bmp->dx;i++)
+         {
+            unsigned int p = (bmp->bpp==16) ? U16(bmp->raw+2*i) : U32(bmp->raw+4*i);
+            unsigned char* px = row+bmp->ncomp*i;
+            px[0] = Field(bmp,0,p);
+            px[1] = Field(bmp,1,p);
+            px[2] = Field(bmp,2,p);
+            if (bmp->ncomp==4) alpha |= (px[3] = Field(bmp,3,p));
+         }
+      }
+   }
+   return alpha;
+}
+
+//
+//  Write accumulated box filter row ty of the image and clear it
+//
+static void FlushRow(unsigned char* image,int dx,int ncomp,int ty,unsigned long long* acc,const unsigned int* cnt,int rows)
+{
+   unsigned char* out = image+(size_t)ncomp*dx*ty;
+   for (int x=0;x<dx;x++)
+   {
+      unsigned long long n = (unsigned long long)cnt[x]*rows;
+      for (int c=0;c<ncomp;c++)
+      {
+         out[ncomp*x+c] = (acc[ncomp*x+c]+n/2)/n;
+         acc[ncomp*x+c] = 0;
+      }
+   }
+}
+
+//
+//  Decode image reduced q times by half
+//  Rows are box filtered into the reduced image as they are decoded, so
+//  only one source row is held in memory
+//
+static unsigned char* ReadImage(bmp_t* bmp,int q,int* DX,int* DY)
+{
+   int dx = MipSize(bmp->dx,q);
+   int dy = MipSize(bmp->dy,q);
+   int ncomp = bmp->ncomp;
+   size_t size = (size_t)ncomp*dx*dy;
+   unsigned char* image = (unsigned char*)MemAlloc(MEM_TEXTURE,size);
+   if (!image) Fatal("Cannot allocate %d bytes of memory for image %s\n",(int)size,bmp->file);
+   int alpha = 0;
+   //  Full size - decode rows bottom to top in place
+   if (!q)
+   {
+      for (int k=0;k<dy;k++)
+         alpha |= ReadRow(bmp,image+(size_t)ncomp*dx*(bmp->topdown ? dy-1-k : k));
+   }
+   //  Reduced - accumulate rows of each output row
+   else
+   {
+      unsigned char* row = (unsigned char*)MemAlloc(MEM_TEMP,ncomp*bmp->dx);
+      unsigned long long* acc = (unsigned long long*)MemCalloc(MEM_TEMP,ncomp*dx,sizeof(unsigned long long));
+      unsigned int* cnt = (unsigned int*)MemCalloc(MEM_TEMP,dx,sizeof(unsigned int));
+      if (!row || !acc || !cnt) Fatal("Cannot allocate row buffers for image %s\n",bmp->file);
+      //  Source columns in each output column (the last one takes the remainder)
+      for (int x=0;x<dx;x++)
+         cnt[x] = (x<dx-1 ? (x+1)<<q : bmp->dx) - (x<<q);
+      int ty=-1,rows=0;
+      for (int k=0;k<bmp->dy;k++)
+      {
+         //  Output row for this source row
+         int y = bmp->topdown ? bmp->dy-1-k : k;
+         int t = (y>>q)<dy ? y>>q : dy-1;
+         if (t!=ty && rows)
+         {
+            FlushRow(image,dx,ncomp,ty,acc,cnt,rows);
+            rows = 0;
+         }
+         ty = t;
+         //  Decode and sum source columns
+         alpha |= ReadRow(bmp,row);
+         const unsigned char* in = row;
+         for (int x=0;x<dx;x++)
+         {
+            unsigned long long* a = acc+ncomp*x;
+            for (unsigned int i=0;i<cnt[x];i++,in+=ncomp)
+               for (int c=0;c<ncomp;c++)
+                  a[c] += in[c];
+         }
+         rows++;
+      }
+      FlushRow(image,dx,ncomp,ty,acc,cnt,rows);
+      MemFree(row);
+      MemFree(acc);
+      MemFree(cnt);
+   }
+   //  Images with an unused alpha channel are opaque
+   if (ncomp==4 && !alpha)
+      for (size_t k=3;k<size;k+=4)
+         image[k] = 255;
+   *DX = dx;
+   *DY = dy;
+   return image;
+}
+
+//
+//  Close BMP file
+//
+static void CloseBMP(bmp_t* bmp)
+{
+   fclose(bmp->f);
+   MemFree(bmp->raw);
+}
+
+//
+//  Pixel layout of an uncompressed 24 or 32 bit BMP file
+//  for direct access to the pixels (used by tiled textures)
+//  Returns 0 for all other formats
+//
+int BMPLayout(const char* file,int* dx,int* dy,int* ncomp,long* offset,int* stride,int* topdown)
+{
+   bmp_t bmp;
+   OpenBMP(&bmp,file);
+   *dx      = bmp.dx;
+   *dy      = bmp.dy;
+   *ncomp   = bmp.bpp/8;
+   *offset  = ftell(bmp.f);
+   *stride  = bmp.stride;
+   *topdown = bmp.topdown;
+   CloseBMP(&bmp);
+   return bmp.k==BI_RGB && (bmp.bpp==24 || bmp.bpp==32);
+}
+
+//  Texture cache, compression and quality settings
+static int cache=0;
+static int compress=0;
+static int quality=0;
+
+//
+//  Select texture quality (0=full 1=half 2=quarter resolution ...)
+//
+void TexQuality(int q)
+{
+   quality = q<0 ? 0 : q;
+}
+
+//
+//  Select caching (0=off 1=cache mip chain next to source)
+//
+void TexCache(int mode)
+{
+   cache = mode;
+}
+
+//
+//  Select compression (0=off 1=BC1/BC3 with cache)
+//
+void TexCompress(int mode)
+{
+   compress = mode;
+}
+
+//
+//  Check for S3TC support
+//
+static int HasS3TC(void)
+{
+   static int s3tc=-1;
+   if (s3tc<0)
+   {
+      const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+      s3tc = ext && strstr(ext,"GL_EXT_texture_compression_s3tc");
+   }
+   return s3tc;
+}
+
+//  Decoded texture ready for upload
+typedef struct
+{
+   const char* file;        //  Source file
+   int dx,dy;               //  Size of level 0
+   unsigned int format;     //  OpenGL internal format
+   int levels;              //  Mip levels
+   int skip;                //  Levels dropped at upload
+   unsigned char* data[32]; //  Level data
+   unsigned int size[32];   //  Level size in bytes
+} teximg_t;
+
+//
+//  Build mip chain (optionally BC1/BC3 compressed) and save it to the cache
+//
+static void BuildChain(teximg_t* img,unsigned char* image,int ncomp,int bc,int save)
+{
+   unsigned char* mip=NULL;
+   img->levels = 0;
+   for (int w=img->dx,h=img->dy;;img->levels++)
+   {
+      const unsigned char* src = mip ? mip : image;
+      unsigned int* size = img->size+img->levels;
+      if (bc)
+         img->data[img->levels] = CompressBC(src,w,h,ncomp,size);
+      else
+      {
+         *size = ncomp*w*h;
+         img->data[img->levels] = (unsigned char*)MemAlloc(MEM_TEXTURE,*size);
+         if (!img->data[img->levels]) Fatal("Cannot allocate %d bytes for mip level of %s\n",*size,img->file);
+         memcpy(img->data[img->levels],src,*size);
+      }
+      if (w==1 && h==1) break;
+      unsigned char* next = HalveImage(src,w,h,ncomp,&w,&h);
+      MemFree(mip);
+      mip = next;
+   }
+   MemFree(mip);
+   img->levels++;
+   if (bc)
+      img->format = (ncomp==4) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+   if (save) TexCacheSave(img->file,img->format,img->dx,img->dy,img->levels,img->data,img->size);
+}
+
+//
+//  Decode BMP file (no OpenGL calls so this can run on any thread)
+//    bc   compress to BC1/BC3
+//    max  maximum texture size
+//    drop number of top mip levels to drop
+//
+static void DecodeTex(teximg_t* img,int bc,int max,int drop)
+{
+   TraceScope("DecodeTex");
+   //  Open file and read header
+   bmp_t bmp;
+   OpenBMP(&bmp,img->file);
+   int ncomp = bmp.ncomp;
+   //  Halve the image as often as the quality setting asks
+   //  and then until it fits the maximum texture size and budget
+   size_t budget;
+   TexMemory(NULL,&budget);
+   int q = quality;
+   while (MipSize(bmp.dx,q)>max || MipSize(bmp.dy,q)>max)
+      q++;
+   while (budget && (size_t)ncomp*MipSize(bmp.dx,q)*MipSize(bmp.dy,q)>budget && (MipSize(bmp.dx,q)>1 || MipSize(bmp.dy,q)>1))
+      q++;
+   if (q>quality) fprintf(stderr,"%s %dx%d reduced to %dx%d to fit\n",img->file,bmp.dx,bmp.dy,MipSize(bmp.dx,q),MipSize(bmp.dy,q));
+   //  Without a mip chain dropped levels are decoded at the reduced size too
+   if (!bc && !cache) q += drop;
 #ifndef GL_VERSION_2_0
    //  OpenGL 2.0 lifts the restriction that texture size must be a power of two
-   for (k=1;k<dx;k*=2);
-   if (k!=dx) Fatal("%s image width not a power of two: %d\n",file,dx);
-   for (k=1;k<dy;k*=2);
-   if (k!=dy) Fatal("%s image height not a power of two: %d\n",file,dy);
+   int k;
+   for (k=1;k<bmp.dx;k*=2);
+   if (k!=bmp.dx) Fatal("%s image width not a power of two: %d\n",img->file,bmp.dx);
+   for (k=1;k<bmp.dy;k*=2);
+   if (k!=bmp.dy) Fatal("%s image height not a power of two: %d\n",img->file,bmp.dy);
 #endif
 
-   //  Allocate image memory
-   unsigned int size = 3*dx*dy;
-   unsigned char* image = (unsigned char*) malloc(size);
-   if (!image) Fatal("Cannot allocate %d bytes of memory for image %s\n",size,file);
-   //  Seek to and read image
-   if (fseek(f,off,SEEK_SET) || fread(image,size,1,f)!=1) Fatal("Error reading data from image %s\n",file);
-   fclose(f);
-   //  Reverse colors (BGR -> RGB)
-   for (k=0;k<size;k+=3)
+   //  Decode image
+   unsigned char* image = ReadImage(&bmp,q,&img->dx,&img->dy);
+   CloseBMP(&bmp);
+   img->format = (ncomp==4) ? GL_RGBA : GL_RGB;
+   //  Build mip chain (cached only at full quality)
+   if (bc || cache)
    {
-      unsigned char temp = image[k];
-      image[k]   = image[k+2];
-      image[k+2] = temp;
+      BuildChain(img,image,ncomp,bc,q==0);
+      img->skip = drop<img->levels ? drop : img->levels-1;
+      MemFree(image);
    }
+   //  Single image
+   else
+   {
+      img->levels  = 1;
+      img->skip    = 0;
+      img->data[0] = image;
+      img->size[0] = ncomp*img->dx*img->dy;
+   }
+}
 
+//
+//  Upload decoded texture (0 creates a new texture) and free it
+//
+static unsigned int UploadTex(teximg_t* img,unsigned int texture)
+{
+   TraceScope("UploadTex");
    //  Sanity check
    ErrCheck("LoadTexBMP");
-   //  Generate 2D texture
-   unsigned int texture;
-   glGenTextures(1,&texture);
-   glBindTexture(GL_TEXTURE_2D,texture);
-   //  Copy image
-   glTexImage2D(GL_TEXTURE_2D,0,GL_RGB,dx,dy,0,GL_RGB,GL_UNSIGNED_BYTE,image);
-   if (glGetError()) Fatal("Error in glTexImage2D %s %dx%d\n",file,dx,dy);
-   //  Scale linearly when image size doesn't match
-   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
-
+   //  Copy image to 2D texture (scaled linearly when size doesn't match)
+   int l = img->skip;
+   texture = TexUpload(texture,img->format,MipSize(img->dx,l),MipSize(img->dy,l),img->levels-l,img->data+l,img->size+l);
    //  Free image memory
-   free(image);
+   for (l=0;l<img->levels;l++)
+      MemFree(img->data[l]);
    //  Return texture name
    return texture;
 }
+
+//
+//  Load BMP file into texture (0 creates a new texture)
+//  dropping the top drop mip levels
+//
+static unsigned int LoadTex(const char* file,unsigned int texture,int drop)
+{
+   //  Cached textures are used as is when the cache is current
+   //  (the cache always holds the full chain so quality drops levels)
+   int bc = compress && HasS3TC();
+   if (bc || cache)
+   {
+      unsigned int tex = TexCacheLoad(file,bc,texture,drop+quality);
+      if (tex) return tex;
+   }
+   //  Decode and upload
+   int max;
+   glGetIntegerv(GL_MAX_TEXTURE_SIZE,&max);
+   teximg_t img = {file};
+   DecodeTex(&img,bc,max,drop);
+   return UploadTex(&img,texture);
+}
+
+//
+//  Load texture from BMP file
+//
+unsigned int LoadTexBMP(const char* file)
+{
+   TraceScope("LoadTexBMP");
+   unsigned int texture = LoadTex(file,0,0);
+   TexManage(texture,file);
+   return texture;
+}
+
+//  Textures decoded in parallel by LoadTexBMPs
+typedef struct
+{
+   teximg_t* img;  //  Decoded textures
+   int bc;         //  Compress
+   int max;        //  Maximum texture size
+} batch_t;
+
+//
+//  Decode one texture of a batch
+//
+static void DecodeBatch(int i,void* arg)
+{
+   batch_t* batch = (batch_t*)arg;
+   if (batch->img[i].file) DecodeTex(batch->img+i,batch->bc,batch->max,0);
+}
+
+//
+//  Load n textures from BMP files
+//  Files are decoded in parallel, then uploaded in one pass on this thread
+//  Texture names are returned in tex in the same order as the files
+//
+void LoadTexBMPs(int n,const char* file[],unsigned int tex[])
+{
+   TraceScope("LoadTexBMPs");
+   batch_t batch;
+   batch.bc = compress && HasS3TC();
+   glGetIntegerv(GL_MAX_TEXTURE_SIZE,&batch.max);
+   batch.img = (teximg_t*)MemCalloc(MEM_TEMP,n,sizeof(teximg_t));
+   if (!batch.img) Fatal("Cannot allocate %d textures\n",n);
+   //  Repeated files share the texture of their first occurrence
+   int* same = (int*)MemAlloc(MEM_TEMP,n*sizeof(int));
+   if (!same) Fatal("Cannot allocate %d textures\n",n);
+   //  Current caches are uploaded directly, the rest are decoded
+   for (int i=0;i<n;i++)
+   {
+      same[i] = -1;
+      for (int j=0;j<i && same[i]<0;j++)
+         if (!strcmp(file[i],file[j])) same[i] = j;
+      tex[i] = (same[i]<0 && (batch.bc || cache)) ? TexCacheLoad(file[i],batch.bc,0,quality) : 0;
+      if (!tex[i] && same[i]<0) batch.img[i].file = file[i];
+   }
+   Parallel(n,DecodeBatch,&batch);
+   //  Upload in order
+   for (int i=0;i<n;i++)
+   {
+      if (same[i]>=0)
+      {
+         tex[i] = tex[same[i]];
+         continue;
+      }
+      if (batch.img[i].file)
+         tex[i] = UploadTex(batch.img+i,0);
+      else if (!tex[i])
+         tex[i] = LoadTex(file[i],0,0);
+      glBindTexture(GL_TEXTURE_2D,tex[i]);
+      TexManage(tex[i],file[i]);
+   }
+   MemFree(same);
+   MemFree(batch.img);
+}
+
+//
+//  Reload texture in place at reduced resolution
+//    drop is the number of times the resolution is halved
+//
+void TexReload(unsigned int texture,const char* file,int drop)
+{
+   LoadTex(file,texture,drop);
+}
@@ -0,0 +1,247 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  4x4 matrix math and transform stack
+//
+//  Matrices are column major like OpenGL, so a Mat4 can be handed straight
+//  to glLoadMatrixf or stored into a buffer.  Each column is a Vec4f (a GCC
+//  vector of four floats) so products are four-wide multiply-adds without
+//  any platform specific intrinsics.  Other compilers get a struct and the
+//  Vec4f functions below do the arithmetic one float at a time.
+//  Transform functions post-multiply like their glTranslate, glRotate and
+//  glScale counterparts.
+//
+
+#ifndef __GNUC__
+//
+//  Vector sum, difference and scale
+//
+Vec4f Vec4fAdd(Vec4f a,Vec4f b)
+{
+   for (int k=0;k<4;k++)
+      a.v[k] += b.v[k];
+   return a;
+}
+
+Vec4f Vec4fSub(Vec4f a,Vec4f b)
+{
+   for (int k=0;k<4;k++)
+      a.v[k] -= b.v[k];
+   return a;
+}
+
+Vec4f Vec4fScale(Vec4f a,float s)
+{
+   for (int k=0;k<4;k++)
+      a.v[k] *= s;
+   return a;
+}
+#endif
+
+//
+//  Identity matrix
+//
+Mat4 Mat4Identity(void)
+{
+   Mat4 m = {{{1,0,0,0},{0,1,0,0},{0,0,1,0},{0,0,0,1}}};
+   return m;
+}
+
+//
+//  Matrix times vector
+//
+Vec4f Mat4Vec(Mat4 m,Vec4f v)
+{
+   return Vec4fAdd(Vec4fAdd(Vec4fScale(m.c[0],V4(v,0)),Vec4fScale(m.c[1],V4(v,1))),
+                   Vec4fAdd(Vec4fScale(m.c[2],V4(v,2)),Vec4fScale(m.c[3],V4(v,3))));
+}
+
+//
+//  Matrix product a*b
+//
+Mat4 Mat4Mul(Mat4 a,Mat4 b)
+{
+   Mat4 r;
+   for (int j=0;j<4;j++)
+      r.c[j] = Mat4Vec(a,b.c[j]);
+   return r;
+}
+
+//
+//  Products a*b[i] for n matrices
+//  (one parent transform applied to many children)
+//
+void Mat4MulN(Mat4 a,const Mat4* b,Mat4* out,int n)
+{
+   for (int i=0;i<n;i++)
+      for (int j=0;j<4;j++)
+         out[i].c[j] = Mat4Vec(a,b[i].c[j]);
+}
+
+//
+//  Translate
+//
+Mat4 Mat4Translate(Mat4 m,float x,float y,float z)
+{
+   m.c[3] = Mat4Vec(m,(Vec4f){x,y,z,1});
+   return m;
+}
+
+//
+//  Rotate th degrees about (x,y,z)
+//
+Mat4 Mat4Rotate(Mat4 m,float th,float x,float y,float z)
+{
+   float l = sqrtf(x*x+y*y+z*z);
+   if (l==0) return m;
+   x /= l;
+   y /= l;
+   z /= l;
+   float c = cosf(th*(float)M_PI/180);
+   float s = sinf(th*(float)M_PI/180);
+   float d = 1-c;
+   Mat4 r = {{{x*x*d+c  ,y*x*d+z*s,x*z*d-y*s,0},
+              {x*y*d-z*s,y*y*d+c  ,y*z*d+x*s,0},
+              {x*z*d+y*s,y*z*d-x*s,z*z*d+c  ,0},
+              {0,0,0,1}}};
+   return Mat4Mul(m,r);
+}
+
+//
+//  Scale
+//
+Mat4 Mat4Scale(Mat4 m,float x,float y,float z)
+{
+   m.c[0] = Vec4fScale(m.c[0],x);
+   m.c[1] = Vec4fScale(m.c[1],y);
+   m.c[2] = Vec4fScale(m.c[2],z);
+   return m;
+}
+
+//
+//  Perspective projection (like gluPerspective)
+//
+Mat4 Mat4Perspective(float fov,float asp,float zn,float zf)
+{
+   float f = 1/tanf(fov*(float)M_PI/360);
+   Mat4 m = {{{f/asp,0,0,0},
+              {0,f,0,0},
+              {0,0,(zf+zn)/(zn-zf),-1},
+              {0,0,2*zf*zn/(zn-zf),0}}};
+   return m;
+}
+
+//
+//  Orthogonal projection (like glOrtho)
+//
+Mat4 Mat4Ortho(float l,float r,float b,float t,float n,float f)
+{
+   Mat4 m = {{{2/(r-l),0,0,0},
+              {0,2/(t-b),0,0},
+              {0,0,-2/(f-n),0},
+              {-(r+l)/(r-l),-(t+b)/(t-b),-(f+n)/(f-n),1}}};
+   return m;
+}
+
+//
+//  Viewing transformation (like gluLookAt)
+//
+Mat4 Mat4LookAt(float ex,float ey,float ez , float cx,float cy,float cz , float ux,float uy,float uz)
+{
+   //  Forward
+   float F[3] = {cx-ex,cy-ey,cz-ez};
+   float l = sqrtf(F[0]*F[0]+F[1]*F[1]+F[2]*F[2]);
+   if (l>0) for (int k=0;k<3;k++) F[k] /= l;
+   //  Side = forward x up
+   float S[3] = {F[1]*uz-F[2]*uy,F[2]*ux-F[0]*uz,F[0]*uy-F[1]*ux};
+   l = sqrtf(S[0]*S[0]+S[1]*S[1]+S[2]*S[2]);
+   if (l>0) for (int k=0;k<3;k++) S[k] /= l;
+   //  Up = side x forward
+   float U[3] = {S[1]*F[2]-S[2]*F[1],S[2]*F[0]-S[0]*F[2],S[0]*F[1]-S[1]*F[0]};
+   Mat4 m = {{{S[0],U[0],-F[0],0},
+              {S[1],U[1],-F[1],0},
+              {S[2],U[2],-F[2],0},
+              {0,0,0,1}}};
+   return Mat4Translate(m,-ex,-ey,-ez);
+}
+
+//
+//  Store matrix as 16 floats
+//
+void Mat4Store(Mat4 m,float out[16])
+{
+   memcpy(out,&m,sizeof(m));
+}
+
+//
+//  Replace the current OpenGL matrix
+//
+void Mat4Load(Mat4 m)
+{
+   glLoadMatrixf((float*)&m);
+}
+
+//
+//  Read an OpenGL matrix (GL_MODELVIEW_MATRIX, GL_PROJECTION_MATRIX, ...)
+//
+Mat4 Mat4Get(unsigned int which)
+{
+   Mat4 m;
+   glGetFloatv(which,(float*)&m);
+   return m;
+}
+
+//
+//  Transform stack
+//  Mirrors the OpenGL matrix stack but lives on the CPU
+//
+void StackInit(mat4stack_t* s)
+{
+   s->n = 0;
+   s->m[0] = Mat4Identity();
+}
+
+void StackPush(mat4stack_t* s)
+{
+   if (s->n+1>=MAT4DEPTH) Fatal("Transform stack overflow\n");
+   s->m[s->n+1] = s->m[s->n];
+   s->n++;
+}
+
+void StackPop(mat4stack_t* s)
+{
+   if (s->n<=0) Fatal("Transform stack underflow\n");
+   s->n--;
+}
+
+void StackLoad(mat4stack_t* s,Mat4 m)
+{
+   s->m[s->n] = m;
+}
+
+void StackMul(mat4stack_t* s,Mat4 m)
+{
+   s->m[s->n] = Mat4Mul(s->m[s->n],m);
+}
+
+void StackTranslate(mat4stack_t* s,float x,float y,float z)
+{
+   s->m[s->n] = Mat4Translate(s->m[s->n],x,y,z);
+}
+
+void StackRotate(mat4stack_t* s,float th,float x,float y,float z)
+{
+   s->m[s->n] = Mat4Rotate(s->m[s->n],th,x,y,z);
+}
+
+void StackScale(mat4stack_t* s,float x,float y,float z)
+{
+   s->m[s->n] = Mat4Scale(s->m[s->n],x,y,z);
+}
+
+Mat4 StackTop(const mat4stack_t* s)
+{
+   return s->m[s->n];
+}
@@ -0,0 +1,145 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  Material state cache
+//
+//  MaterialSet and MaterialSetf take the same arguments as glMaterialfv and
+//  glMaterialf but remember the ambient, diffuse, specular, emission and
+//  shininess last set on each face and skip calls that would not change
+//  them.  Code that changes materials any other way (glMaterial directly,
+//  glPopAttrib with GL_LIGHTING_BIT, display lists) must call
+//  MaterialInvalidate afterwards.  Do not use them while compiling a
+//  display list since the calls they skip would be missing from the list.
+//  With GL_COLOR_MATERIAL enabled OpenGL takes the tracked parameters from
+//  glColor, so the cache only decides whether glMaterial is needed.
+//  MaterialFrame closes a frame and MaterialStats returns the calls made
+//  and skipped in the previous frame.
+//
+
+//  Cached parameters
+#define AMBIENT   0
+#define DIFFUSE   1
+#define SPECULAR  2
+#define EMISSION  3
+#define SHININESS 4
+
+static float value[2][5][4];   //  Values by face and parameter
+static int   known[2][5];      //  Value is current
+static int   set=0,skip=0;     //  Calls this frame
+static int   lastset=0,lastskip=0;  //  Calls previous frame
+
+//
+//  Parameter index and number of values (-1 if not cached)
+//
+static int Param(unsigned int pname,int* n)
+{
+   *n = 4;
+   switch (pname)
+   {
+      case GL_AMBIENT:   return AMBIENT;
+      case GL_DIFFUSE:   return DIFFUSE;
+      case GL_SPECULAR:  return SPECULAR;
+      case GL_EMISSION:  return EMISSION;
+      case GL_SHININESS: *n = 1; return SHININESS;
+      default:           return -1;
+   }
+}
+
+//
+//  Is parameter p of face f already v?
+//
+static int Same(int f,int p,int n,const float* v)
+{
+   return known[f][p] && !memcmp(value[f][p],v,n*sizeof(float));
+}
+
+//
+//  Remember parameter p of face f
+//
+static void Store(int f,int p,int n,const float* v)
+{
+   memcpy(value[f][p],v,n*sizeof(float));
+   known[f][p] = 1;
+}
+
+//
+//  Set material parameter unless it already has this value
+//
+void MaterialSet(unsigned int face,unsigned int pname,const float* v)
+{
+   int f0 = face==GL_BACK ? 1 : 0;
+   int f1 = face==GL_FRONT ? 0 : 1;
+   int n;
+   int p = Param(pname,&n);
+   //  Ambient and diffuse together
+   if (pname==GL_AMBIENT_AND_DIFFUSE)
+   {
+      int same = 1;
+      for (int f=f0;f<=f1;f++)
+         same &= Same(f,AMBIENT,4,v) && Same(f,DIFFUSE,4,v);
+      if (same)
+      {
+         skip++;
+         return;
+      }
+      for (int f=f0;f<=f1;f++)
+      {
+         Store(f,AMBIENT,4,v);
+         Store(f,DIFFUSE,4,v);
+      }
+   }
+   //  Single parameter
+   else if (p>=0)
+   {
+      int same = 1;
+      for (int f=f0;f<=f1;f++)
+         same &= Same(f,p,n,v);
+      if (same)
+      {
+         skip++;
+         return;
+      }
+      for (int f=f0;f<=f1;f++)
+         Store(f,p,n,v);
+   }
+   glMaterialfv(face,pname,v);
+   set++;
+}
+
+//
+//  Set scalar material parameter unless it already has this value
+//
+void MaterialSetf(unsigned int face,unsigned int pname,float v)
+{
+   float v4[4] = {v,0,0,0};
+   MaterialSet(face,pname,v4);
+}
+
+//
+//  Forget the cached values (materials were changed some other way)
+//
+void MaterialInvalidate(void)
+{
+   memset(known,0,sizeof(known));
+}
+
+//
+//  End of frame
+//
+void MaterialFrame(void)
+{
+   lastset = set;
+   lastskip = skip;
+   set = skip = 0;
+}
+
+//
+//  Material calls made and skipped in the previous frame
+//
+void MaterialStats(int* made,int* skipped)
+{
+   if (made)    *made = lastset;
+   if (skipped) *skipped = lastskip;
+}
@@ -0,0 +1,180 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  Memory accounting
+//
+//  Library allocations go through MemAlloc/MemCalloc/MemRealloc/MemFree,
+//  which keep the size and category in a header in front of the block.
+//  GPU objects are recorded with MemGL under their OpenGL name, so
+//  recreating or deleting an object (bytes=0) replaces its old size.
+//  Live and peak bytes are kept for each category (mesh, texture, text,
+//  temp) and for MEM_ALL on both the CPU and the GPU.  The counters are
+//  atomic because textures are decoded on worker threads.
+//
+//  GPU sizes are what the data needs, not what the driver allocates
+//  (padding, alignment and copies it keeps are not visible through GL).
+//  Display lists report no size at all, so their callers estimate it.
+//
+
+//  Block header (keeps the block 16 byte aligned)
+typedef union
+{
+   struct
+   {
+      size_t n;   //  Bytes requested
+      int cat;    //  Category
+   } h;
+   double align[2];
+} memhdr_t;
+
+//  GPU object
+typedef struct
+{
+   size_t bytes;  //  Size recorded
+   int cat;       //  Category
+} memobj_t;
+
+//  Live and peak bytes per category
+static size_t cpu[MEM_ALL+1],cpupeak[MEM_ALL+1];
+static size_t gpu[MEM_ALL+1],gpupeak[MEM_ALL+1];
+//  GPU objects indexed by type and name
+static memobj_t* obj[3]={NULL,NULL,NULL};
+static unsigned int nobj[3]={0,0,0};
+
+static const char* catname[MEM_ALL+1] = {"Mesh","Texture","Text","Temp","Total"};
+
+//
+//  Add d bytes to a category and the total
+//
+static void Count(size_t live[],size_t peak[],int cat,long long d)
+{
+   int c[2] = {cat,MEM_ALL};
+   for (int k=0;k<2;k++)
+   {
+      size_t v = __atomic_add_fetch(live+c[k],(size_t)d,__ATOMIC_RELAXED);
+      size_t p = __atomic_load_n(peak+c[k],__ATOMIC_RELAXED);
+      while (v>p && !__atomic_compare_exchange_n(peak+c[k],&p,v,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+   }
+}
+
+//
+//  Check category
+//
+static void Check(int cat)
+{
+   if (cat<0 || cat>=MEM_ALL) Fatal("Invalid memory category %d\n",cat);
+}
+
+//
+//  Allocate n bytes in category cat (NULL on failure like malloc)
+//
+void* MemAlloc(int cat,size_t n)
+{
+   Check(cat);
+   memhdr_t* h = (memhdr_t*)malloc(sizeof(memhdr_t)+n);
+   if (!h) return NULL;
+   h->h.n = n;
+   h->h.cat = cat;
+   Count(cpu,cpupeak,cat,n);
+   return h+1;
+}
+
+//
+//  Allocate n zeroed elements of size bytes in category cat
+//
+void* MemCalloc(int cat,size_t n,size_t size)
+{
+   Check(cat);
+   if (size && n>((size_t)-1-sizeof(memhdr_t))/size) return NULL;
+   memhdr_t* h = (memhdr_t*)calloc(1,sizeof(memhdr_t)+n*size);
+   if (!h) return NULL;
+   h->h.n = n*size;
+   h->h.cat = cat;
+   Count(cpu,cpupeak,cat,n*size);
+   return h+1;
+}
+
+//
+//  Resize block p to n bytes in category cat (p=NULL allocates)
+//  On failure returns NULL and leaves p unchanged like realloc
+//
+void* MemRealloc(int cat,void* p,size_t n)
+{
+   if (!p) return MemAlloc(cat,n);
+   Check(cat);
+   memhdr_t* h = (memhdr_t*)p-1;
+   size_t old = h->h.n;
+   int oldcat = h->h.cat;
+   h = (memhdr_t*)realloc(h,sizeof(memhdr_t)+n);
+   if (!h) return NULL;
+   h->h.n = n;
+   h->h.cat = cat;
+   Count(cpu,cpupeak,oldcat,-(long long)old);
+   Count(cpu,cpupeak,cat,n);
+   return h+1;
+}
+
+//
+//  Free block from MemAlloc, MemCalloc or MemRealloc
+//
+void MemFree(void* p)
+{
+   if (!p) return;
+   memhdr_t* h = (memhdr_t*)p-1;
+   Count(cpu,cpupeak,h->h.cat,-(long long)h->h.n);
+   free(h);
+}
+
+//
+//  Record the size of an OpenGL object (call on the GL thread)
+//    type   MEM_TEXOBJ, MEM_BUFOBJ or MEM_LISTOBJ
+//    name   OpenGL name
+//    bytes  size now (0 when deleted)
+//
+void MemGL(int type,unsigned int name,int cat,size_t bytes)
+{
+   Check(cat);
+   if (type<0 || type>2) Fatal("Invalid GL object type %d\n",type);
+   //  Grow table to cover this name
+   if (name>=nobj[type])
+   {
+      unsigned int n = name+64;
+      obj[type] = (memobj_t*)realloc(obj[type],n*sizeof(memobj_t));
+      if (!obj[type]) Fatal("Cannot allocate GL object table\n");
+      memset(obj[type]+nobj[type],0,(n-nobj[type])*sizeof(memobj_t));
+      nobj[type] = n;
+   }
+   memobj_t* o = obj[type]+name;
+   Count(gpu,gpupeak,o->cat,-(long long)o->bytes);
+   o->bytes = bytes;
+   o->cat = cat;
+   Count(gpu,gpupeak,cat,bytes);
+}
+
+//
+//  Live and peak bytes for a category or MEM_ALL (pointers may be NULL)
+//
+void MemQuery(int cat,size_t* cpulive,size_t* cpumax,size_t* gpulive,size_t* gpumax)
+{
+   if (cat<0 || cat>MEM_ALL) Fatal("Invalid memory category %d\n",cat);
+   if (cpulive) *cpulive = __atomic_load_n(cpu+cat,__ATOMIC_RELAXED);
+   if (cpumax)  *cpumax  = __atomic_load_n(cpupeak+cat,__ATOMIC_RELAXED);
+   if (gpulive) *gpulive = __atomic_load_n(gpu+cat,__ATOMIC_RELAXED);
+   if (gpumax)  *gpumax  = __atomic_load_n(gpupeak+cat,__ATOMIC_RELAXED);
+}
+
+//
+//  Show every category as HUD lines k, k+1, ... starting at (x,y) going up
+//
+void MemHud(int k,int x,int y)
+{
+   for (int c=0;c<=MEM_ALL;c++,y+=20)
+   {
+      size_t cl,cp,gl,gp;
+      MemQuery(c,&cl,&cp,&gl,&gp);
+      HudLine(k+c,x,y,"%-8s CPU %8.2fMB peak %8.2fMB  GPU %8.2fMB peak %8.2fMB",
+         catname[c],cl/1048576.0,cp/1048576.0,gl/1048576.0,gp/1048576.0);
+   }
+}
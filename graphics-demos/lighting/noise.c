@@ -0,0 +1,346 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  Procedural noise textures
+//
+//  NOISE_PERLIN   gradient noise on a square lattice
+//  NOISE_SIMPLEX  gradient noise on a triangular lattice (does not tile)
+//  NOISE_WORLEY   distance to the nearest of one random point per cell
+//  Octaves beyond the first add fractal (fBm) detail at twice the frequency
+//  and half the amplitude each.  Perlin and Worley textures repeat seamlessly.
+//
+//  The image is built a row at a time so the inner loops run over plain
+//  float arrays the compiler can vectorize, and bands of rows are spread
+//  across all cores.  Textures are memoized on their parameters in a hash
+//  table, so asking for the same texture again is a constant time lookup
+//  however many textures there are.
+//
+
+//  Rows per work item
+#define BAND 16
+
+//  Texture parameters
+typedef struct
+{
+   int type;           //  NOISE_PERLIN, NOISE_SIMPLEX or NOISE_WORLEY
+   unsigned int seed;  //  Random seed
+   int size;           //  Width and height in pixels
+   int freq;           //  Lattice cells across the texture
+   int octaves;        //  fBm octaves
+} noise_t;
+
+//  Generation job
+typedef struct
+{
+   const noise_t* par;   //  Parameters
+   unsigned char* image; //  Luminance image
+} noisejob_t;
+
+//  Memoized textures
+typedef struct
+{
+   noise_t par;          //  Parameters
+   unsigned int tex;     //  Texture name
+} noisetex_t;
+static noisetex_t* memo=NULL;
+static int nmemo=0;
+//  Hash table of memo index+1 (0=empty slot)
+static int* slot=NULL;
+static int  nslot=0;   //  Slots (power of two)
+
+//
+//  Hash lattice point to 32 bits
+//
+static unsigned int Hash(int x,int y,unsigned int seed)
+{
+   unsigned int h = seed ^ (unsigned int)x*0x8da6b343 ^ (unsigned int)y*0xd8163841;
+   h ^= h>>16;
+   h *= 0x7feb352d;
+   h ^= h>>15;
+   h *= 0x846ca68b;
+   h ^= h>>16;
+   return h;
+}
+
+//
+//  Unit gradient for lattice point (one of eight directions)
+//
+static void Gradient(int x,int y,unsigned int seed,float* gx,float* gy)
+{
+   static const float g[8][2] = {{1,0},{-1,0},{0,1},{0,-1},{0.7071f,0.7071f},{-0.7071f,0.7071f},{0.7071f,-0.7071f},{-0.7071f,-0.7071f}};
+   int k = Hash(x,y,seed)&7;
+   *gx = g[k][0];
+   *gy = g[k][1];
+}
+
+//
+//  Wrap lattice index to the period
+//
+static int Wrap(int i,int period)
+{
+   i %= period;
+   return i<0 ? i+period : i;
+}
+
+//
+//  Perlin noise for one row (0 to 1)
+//    x = (i+0.5)*freq/nx and the lattice repeats every freq cells
+//
+static void PerlinRow(float* out,int nx,float y,int freq,unsigned int seed)
+{
+   //  Gradients along the two lattice rows bracketing y
+   float gx0[freq+1],gy0[freq+1],gx1[freq+1],gy1[freq+1];
+   int iy = (int)floorf(y);
+   float fy = y-iy;
+   for (int i=0;i<=freq;i++)
+   {
+      Gradient(Wrap(i,freq),Wrap(iy  ,freq),seed,gx0+i,gy0+i);
+      Gradient(Wrap(i,freq),Wrap(iy+1,freq),seed,gx1+i,gy1+i);
+   }
+   float v = fy*fy*fy*(fy*(fy*6-15)+10);
+   //  Blend corner contributions
+   float s = (float)freq/nx;
+   for (int i=0;i<nx;i++)
+   {
+      float x = (i+0.5f)*s;
+      int ix = (int)x;
+      float fx = x-ix;
+      float n00 = gx0[ix  ]*fx     + gy0[ix  ]*fy;
+      float n10 = gx0[ix+1]*(fx-1) + gy0[ix+1]*fy;
+      float n01 = gx1[ix  ]*fx     + gy1[ix  ]*(fy-1);
+      float n11 = gx1[ix+1]*(fx-1) + gy1[ix+1]*(fy-1);
+      float u = fx*fx*fx*(fx*(fx*6-15)+10);
+      float n0 = n00 + u*(n10-n00);
+      float n1 = n01 + u*(n11-n01);
+      out[i] = 0.5f + 0.7071f*(n0 + v*(n1-n0));
+   }
+}
+
+//
+//  Simplex noise for one row (0 to 1)
+//
+static void SimplexRow(float* out,int nx,float y,int freq,unsigned int seed)
+{
+   const float F2 = 0.3660254f;  //  (sqrt(3)-1)/2
+   const float G2 = 0.2113249f;  //  (3-sqrt(3))/6
+   float s = (float)freq/nx;
+   for (int i=0;i<nx;i++)
+   {
+      float x = (i+0.5f)*s;
+      //  Skew to find the simplex cell
+      float k = (x+y)*F2;
+      int ix = (int)floorf(x+k);
+      int iy = (int)floorf(y+k);
+      float t = (ix+iy)*G2;
+      float x0 = x-(ix-t);
+      float y0 = y-(iy-t);
+      //  Middle corner is in the lower or upper triangle
+      int i1 = x0>y0;
+      int j1 = 1-i1;
+      float xc[3] = {x0,x0-i1+G2,x0-1+2*G2};
+      float yc[3] = {y0,y0-j1+G2,y0-1+2*G2};
+      int   dx[3] = {0,i1,1};
+      int   dy[3] = {0,j1,1};
+      //  Sum corner contributions
+      float n=0;
+      for (int c=0;c<3;c++)
+      {
+         float r = 0.5f - xc[c]*xc[c] - yc[c]*yc[c];
+         if (r>0)
+         {
+            float gx,gy;
+            Gradient(ix+dx[c],iy+dy[c],seed,&gx,&gy);
+            r *= r;
+            n += r*r*(gx*xc[c]+gy*yc[c]);
+         }
+      }
+      out[i] = 0.5f + 35*n;
+   }
+}
+
+//
+//  Worley noise for one row (0 to 1)
+//    distance to the nearest feature point with one point per cell
+//
+static void WorleyRow(float* out,int nx,float y,int freq,unsigned int seed)
+{
+   //  Feature points in the three lattice rows around y
+   //  (one extra cell on each side so every pixel sees its neighbors)
+   int iy = (int)floorf(y);
+   float px[3][freq+2],py[3][freq+2];
+   for (int j=0;j<3;j++)
+      for (int i=0;i<freq+2;i++)
+      {
+         unsigned int h = Hash(Wrap(i-1,freq),Wrap(iy+j-1,freq),seed);
+         px[j][i] = i-1 + (h&0xFFFF)/65536.0f;
+         py[j][i] = iy+j-1 + (h>>16)/65536.0f;
+      }
+   //  Nearest point
+   float s = (float)freq/nx;
+   for (int i=0;i<nx;i++)
+   {
+      float x = (i+0.5f)*s;
+      int ix = (int)x;
+      float d2 = 2;
+      for (int j=0;j<3;j++)
+         for (int k=ix;k<ix+3;k++)
+         {
+            float dx = px[j][k]-x;
+            float dy = py[j][k]-y;
+            float d = dx*dx+dy*dy;
+            if (d<d2) d2 = d;
+         }
+      out[i] = sqrtf(d2);
+   }
+}
+
+//
+//  First slot to probe for parameters par
+//
+static int Slot(const noise_t* par)
+{
+   return Hash(par->type|par->octaves<<8,par->size^par->freq<<16,par->seed) & (nslot-1);
+}
+
+//
+//  Find memoized texture (0 if not made yet)
+//
+static unsigned int MemoFind(const noise_t* par)
+{
+   if (!nslot) return 0;
+   for (int k=Slot(par);slot[k];k=(k+1)&(nslot-1))
+      if (!memcmp(&memo[slot[k]-1].par,par,sizeof(noise_t))) return memo[slot[k]-1].tex;
+   return 0;
+}
+
+//
+//  Remember texture, keeping the table at most half full
+//
+static void MemoAdd(const noise_t* par,unsigned int tex)
+{
+   memo = (noisetex_t*)MemRealloc(MEM_TEXTURE,memo,(nmemo+1)*sizeof(noisetex_t));
+   if (!memo) Fatal("Cannot allocate memory for noise textures\n");
+   memo[nmemo].par = *par;
+   memo[nmemo++].tex = tex;
+   if (2*nmemo>nslot)
+   {
+      MemFree(slot);
+      nslot = nslot ? 2*nslot : 64;
+      slot = (int*)MemCalloc(MEM_TEXTURE,nslot,sizeof(int));
+      if (!slot) Fatal("Cannot allocate memory for noise textures\n");
+      for (int i=0;i<nmemo;i++)
+      {
+         int k = Slot(&memo[i].par);
+         while (slot[k]) k = (k+1)&(nslot-1);
+         slot[k] = i+1;
+      }
+   }
+   else
+   {
+      int k = Slot(par);
+      while (slot[k]) k = (k+1)&(nslot-1);
+      slot[k] = nmemo;
+   }
+}
+
+//
+//  Generate a band of rows
+//
+static void NoiseBand(int band,void* arg)
+{
+   noisejob_t* job = (noisejob_t*)arg;
+   const noise_t* par = job->par;
+   int nx = par->size;
+   float sum[nx],row[nx];
+   for (int j=band*BAND;j<(band+1)*BAND && j<nx;j++)
+   {
+      //  Sum octaves
+      float amp=1,norm=0;
+      memset(sum,0,sizeof(sum));
+      for (int o=0,freq=par->freq;o<par->octaves;o++,freq*=2,amp/=2)
+      {
+         float y = (j+0.5f)*freq/nx;
+         unsigned int seed = par->seed+o;
+         if (par->type==NOISE_WORLEY)
+            WorleyRow(row,nx,y,freq,seed);
+         else if (par->type==NOISE_SIMPLEX)
+            SimplexRow(row,nx,y,freq,seed);
+         else
+            PerlinRow(row,nx,y,freq,seed);
+         for (int i=0;i<nx;i++)
+            sum[i] += amp*row[i];
+         norm += amp;
+      }
+      //  Map 0-1 to half to full brightness
+      unsigned char* out = job->image + j*nx;
+      for (int i=0;i<nx;i++)
+      {
+         float v = sum[i]/norm;
+         v = v<0 ? 0 : v>1 ? 1 : v;
+         out[i] = (unsigned char)(127.5f+127.5f*v);
+      }
+   }
+}
+
+//
+//  Procedural noise texture
+//    type     NOISE_PERLIN, NOISE_SIMPLEX or NOISE_WORLEY
+//    seed     random seed
+//    size     width and height in pixels
+//    freq     lattice cells across the texture
+//    octaves  fBm octaves (1 is plain noise)
+//  The texture is luminance from half to full brightness
+//  meant to modulate the material color
+//  When lazy is set a texture that is not made yet is only made if Lazy
+//  allows it, otherwise 0 is returned
+//
+static unsigned int Noise(int type,unsigned int seed,int size,int freq,int octaves,int lazy)
+{
+   if (size<1) Fatal("Invalid noise texture size %d\n",size);
+   //  Octaves finer than a pixel add nothing
+   noise_t par = {type,seed,size,freq<1 ? 1 : freq,octaves<1 ? 1 : octaves};
+   while (par.octaves>1 && (par.freq<<(par.octaves-1))>size)
+      par.octaves--;
+   //  Return memoized texture
+   unsigned int tex = MemoFind(&par);
+   if (tex) return tex;
+   if (lazy && !Lazy()) return 0;
+   //  Generate image
+   noisejob_t job = {&par,(unsigned char*)MemAlloc(MEM_TEXTURE,size*size)};
+   if (!job.image) Fatal("Cannot allocate %d bytes for noise texture\n",size*size);
+   Parallel((size+BAND-1)/BAND,NoiseBand,&job);
+   //  Build mip chain and upload
+   unsigned char* data[32];
+   unsigned int bytes[32];
+   int levels=0;
+   data[0] = job.image;
+   for (int w=size,h=size;;)
+   {
+      bytes[levels++] = w*h;
+      if (w==1 && h==1) break;
+      data[levels] = HalveImage(data[levels-1],w,h,1,&w,&h);
+   }
+   tex = TexUpload(0,GL_LUMINANCE,size,size,levels,data,bytes);
+   for (int l=0;l<levels;l++)
+      MemFree(data[l]);
+   MemoAdd(&par,tex);
+   return tex;
+}
+
+//
+//  Procedural noise texture (made now)
+//
+unsigned int NoiseTexture(int type,unsigned int seed,int size,int freq,int octaves)
+{
+   return Noise(type,seed,size,freq,octaves,0);
+}
+
+//
+//  Procedural noise texture (0 until Lazy allows it to be made)
+//
+unsigned int NoiseTextureLazy(int type,unsigned int seed,int size,int freq,int octaves)
+{
+   return Noise(type,seed,size,freq,octaves,1);
+}
@@ -0,0 +1,90 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+//
+//  Run func(i,arg) for i=0..n-1 on all cores
+//  Work items are handed out one at a time so uneven items balance out
+//  The calling thread works too and returns when every item is done
+//  Parallel called from a work item runs its items serially
+//  func must not make OpenGL calls
+//
+
+//  Maximum number of threads
+#define MAXTHREAD 64
+
+//  Shared work queue
+typedef struct
+{
+   void (*func)(int,void*);  //  Work function
+   void* arg;                //  Work function argument
+   int n;                    //  Number of work items
+   int next;                 //  Next work item
+} work_t;
+
+//  Set while this thread runs work items
+static __thread int busy=0;
+
+//
+//  Number of processors
+//
+int NumCPU(void)
+{
+   static int ncpu=0;
+   if (!ncpu)
+   {
+#ifdef _WIN32
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      ncpu = info.dwNumberOfProcessors;
+#else
+      ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+      if (ncpu<1) ncpu = 1;
+      if (ncpu>MAXTHREAD) ncpu = MAXTHREAD;
+   }
+   return ncpu;
+}
+
+//
+//  Worker thread - pull items until the queue is empty
+//
+static void* Worker(void* arg)
+{
+   work_t* work = (work_t*)arg;
+   int i;
+   int was = busy;
+   busy = 1;
+   while ((i = __atomic_fetch_add(&work->next,1,__ATOMIC_RELAXED)) < work->n)
+      work->func(i,work->arg);
+   busy = was;
+   return NULL;
+}
+
+//
+//  Run work items in parallel
+//
+void Parallel(int n,void (*func)(int,void*),void* arg)
+{
+   work_t work = {func,arg,n,0};
+   pthread_t thread[MAXTHREAD];
+   //  One thread per core, but no more than there are items
+   //  and only this one when already on a worker
+   int nt = busy ? 1 : NumCPU();
+   if (nt>n) nt = n;
+   //  Start helpers (fall back to fewer threads if creation fails)
+   int k=0;
+   while (k<nt-1 && !pthread_create(thread+k,NULL,Worker,&work))
+      k++;
+   //  Work on this thread too
+   Worker(&work);
+   //  Wait for helpers
+   for (int i=0;i<k;i++)
+      pthread_join(thread[i],NULL);
+}
@@ -0,0 +1,231 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+//  Performance overlay
+//
+//  PerfHud records the time since the previous call as the frame time, so
+//  call it once every frame whether or not the overlay is shown.
+//  PerfToggle cycles between no overlay, the performance page and the
+//  memory page (MemHud).  The performance page shows a bar graph of the
+//  last SAMPLES frame times (red below 60 fps) as a HUD line of quads and
+//  sets HUD lines with
+//    min/avg/p99 frame time and the cost of the overlay including HudDraw
+//    GL calls, triangles and draws      (library built with -DGLSTATS)
+//    or only the draws and triangles reported with GlDrawCount, labelled
+//    tracked since immediate mode and display lists are not included
+//    resident texture memory
+//    material calls made and skipped by the cache (MaterialSet)
+//    CPU time per TraceScope name       (library built with -DTRACE)
+//    GPU time per GpuBegin scope
+//  The numbers and the graph are refreshed every UPDATE seconds so the
+//  cached HUD layer only re-renders a few times a second, which keeps the
+//  overlay within BUDGET.
+//
+
+#define SAMPLES 120    //  Frame times in the graph
+#define UPDATE  0.5    //  Seconds between text updates
+#define GW      240    //  Graph width (pixels)
+#define GH      60     //  Graph height (pixels)
+#define MAXCPU  8      //  CPU scopes shown
+#define BUDGET  0.1    //  Overlay cost budget (ms)
+
+static int    show=0;          //  Page shown (0=none 1=performance 2=memory)
+static double last=-1;         //  Time of previous frame (s)
+static float  ms[SAMPLES];     //  Frame times (ms)
+static int    nms=0;           //  Frame times recorded
+static double next=0;          //  Time of next text update
+static double cost=0;          //  Time spent in PerfHud this period (s)
+static int    ncost=0;         //  Calls this period
+//  Text values
+static float  tmin,tavg,tp99;  //  Frame time statistics (ms)
+static float  top=1000/60.0;   //  Graph scale (ms)
+static double overlay=0;       //  Average overlay cost (ms)
+static float  graph[4*(SAMPLES+2)][6];  //  Graph quads
+static int    ngraph=0;        //  Graph vertices
+static int    gx=-1,gy=-1;     //  Graph position
+#ifndef GLSTATS
+static unsigned int draws,triangles;  //  Counts of the last frame
+static unsigned int sdraws,striangles;//  Counts shown
+#endif
+
+//
+//  Wall clock in seconds
+//
+static double Now(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER f,c;
+   QueryPerformanceFrequency(&f);
+   QueryPerformanceCounter(&c);
+   return (double)c.QuadPart/f.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
+
+//
+//  Compare floats for qsort
+//
+static int Compare(const void* a,const void* b)
+{
+   float x = *(const float*)a;
+   float y = *(const float*)b;
+   return (x>y) - (x<y);
+}
+
+//
+//  Show the next page of the overlay
+//
+void PerfToggle(void)
+{
+   show = (show+1)%3;
+}
+
+//
+//  Update the frame time statistics
+//
+static void Statistics(void)
+{
+   int n = nms<SAMPLES ? nms : SAMPLES;
+   if (!n) return;
+   float s[SAMPLES];
+   memcpy(s,ms,n*sizeof(float));
+   qsort(s,n,sizeof(float),Compare);
+   double sum=0;
+   for (int k=0;k<n;k++)
+      sum += s[k];
+   tmin = s[0];
+   tavg = sum/n;
+   tp99 = s[(99*n-1)/100];
+   //  Scale the graph in multiples of 60 fps
+   top = 1000/60.0;
+   while (top<s[n-1]) top *= 2;
+   overlay = ncost ? 1e3*cost/ncost : 0;
+   cost = 0;
+   ncost = 0;
+#ifndef GLSTATS
+   sdraws = draws;
+   striangles = triangles;
+#endif
+}
+
+//
+//  Add a quad to the graph vertex array
+//
+static int Quad(float v[][6],int n,float x0,float y0,float x1,float y1,const float c[4])
+{
+   float q[4][2] = {{x0,y0},{x1,y0},{x1,y1},{x0,y1}};
+   for (int k=0;k<4;k++,n++)
+   {
+      v[n][0] = q[k][0];
+      v[n][1] = q[k][1];
+      memcpy(v[n]+2,c,4*sizeof(float));
+   }
+   return n;
+}
+
+//
+//  Build the frame time graph with its lower left corner at (x,y)
+//
+static void Graph(int x,int y)
+{
+   //  Background, a bar per frame and the 60 fps line
+   const float bg[]   = {0,0,0,0.5};
+   const float bar[]  = {0,0.8,0,1};
+   const float slow[] = {1,0.2,0,1};
+   const float ref[]  = {0.6,0.6,0.6,1};
+   float w = (float)GW/SAMPLES;
+   int n = Quad(graph,0,x,y,x+GW,y+GH,bg);
+   int m = nms<SAMPLES ? nms : SAMPLES;
+   for (int k=0;k<m;k++)
+   {
+      float t = ms[(nms-m+k)%SAMPLES];
+      float h = GH*(t<top ? t : top)/top;
+      n = Quad(graph,n,x+k*w,y,x+(k+1)*w-1,y+h,t>1000/60.0?slow:bar);
+   }
+   float y60 = y + GH*(1000/60.0)/top;
+   ngraph = Quad(graph,n,x,y60,x+GW,y60+1,ref);
+   gx = x;
+   gy = y;
+}
+
+//
+//  Record the frame time and draw the overlay at (x,y) using HUD lines
+//  k, k+1, ... above the graph (call once per frame before HudDraw)
+//
+void PerfHud(int k,int x,int y)
+{
+   double t0 = Now();
+   if (last>=0) ms[nms++%SAMPLES] = 1e3*(t0-last);
+   last = t0;
+#ifndef GLSTATS
+   GlDrawFrame(&draws,&triangles);
+#endif
+   if (!show) return;
+   //  Memory page
+   if (show==2)
+   {
+      glColor3f(1,1,1);
+      MemHud(k,x,y);
+      return;
+   }
+   //  Refresh text and graph
+   if (t0>=next || x!=gx || y!=gy)
+   {
+      Statistics();
+      Graph(x,y);
+      next = t0+UPDATE;
+   }
+   HudQuads(k++,ngraph,(const float(*)[6])graph);
+   y += GH+10;
+   //  Frame time
+   glColor3f(1,1,1);
+   HudLine(k++,x,y,"Frame min %.2f avg %.2f p99 %.2f ms (%.0f fps) overlay %.3f ms (budget %.1f %s)",
+      tmin,tavg,tp99,tavg>0?1e3/tavg:0,overlay,BUDGET,overlay<BUDGET?"met":"over");
+   y += 20;
+   //  Texture memory
+   size_t res,bud;
+   TexMemory(&res,&bud);
+   if (bud)
+      HudLine(k++,x,y,"Textures %.1f of %.1f MB",res/1048576.0,bud/1048576.0);
+   else
+      HudLine(k++,x,y,"Textures %.1f MB",res/1048576.0);
+   y += 20;
+   //  Material cache
+   int made,skipped;
+   MaterialStats(&made,&skipped);
+   HudLine(k++,x,y,"Materials set %d skipped %d",made,skipped);
+   y += 20;
+   //  Calls, triangles and draws
+#ifdef GLSTATS
+   GlStatHud(k,x,y);
+   k += 2;
+   y += 40;
+#else
+   HudLine(k++,x,y,"Tracked draws %u triangles %u (all draws n/a without -DGLSTATS)",sdraws,striangles);
+   y += 20;
+#endif
+   //  CPU time per scope
+#ifdef TRACE
+   const char* name;
+   double cpu;
+   for (int i=0;i<MAXCPU && TraceStat(i,&name,&cpu);i++,y+=20)
+      HudLine(k++,x,y,"CPU %-8s %6.3fms",name,cpu);
+#else
+   HudLine(k++,x,y,"CPU scopes need -DTRACE");
+   y += 20;
+#endif
+   //  GPU time per scope
+   GpuHud(k,x,y);
+   //  The last HudDraw is part of the overlay
+   cost += Now()-t0 + HudTime();
+   ncost++;
+}
@@ -6,8 +6,171 @@
 //  Convenience routine to output raster text
 //  Use VARARGS to make this more flexible
 //
+//  The font is rendered once into a texture atlas.  Once a program has
+//  called PrintFlush, Print only records a textured quad per character at
+//  the current raster position (which it advances just like
+//  glutBitmapCharacter) and PrintFlush draws every string of the frame
+//  with a single call, so call it before the buffers are swapped.  The
+//  queue holds MAXQUAD vertices and is flushed early when full.  Programs
+//  that never call PrintFlush and contexts without framebuffer objects
+//  get text drawn one bitmap at a time.
+//
 
 #define LEN 8192  //  Maximum length of text string
+#define FONT GLUT_BITMAP_HELVETICA_18
+
+#ifdef GL_VERSION_3_0
+//  Glyph atlas
+#define FIRST 32      //  First character in atlas
+#define LAST  126     //  Last character in atlas
+#define COLS  16      //  Characters per atlas row
+#define CELLH 28      //  Cell height
+#define BASE  8       //  Baseline above the bottom of the cell
+#define PAD   2       //  Space left of the raster position
+#define MAXQUAD (4*LEN) //  Queued vertices
+static int atlas=-1;  //  Atlas texture (0=no atlas -1=not built yet)
+static int cw;        //  Cell width
+static int aw,ah;     //  Atlas size
+static float adv[LAST+1];  //  Character advance
+
+//  Quad vertex (matches GL_T2F_C4UB_V3F)
+typedef struct
+{
+   float s,t;
+   unsigned char rgba[4];
+   float x,y,z;
+} glyph_t;
+//  Quads waiting for PrintFlush
+static glyph_t* quad=NULL;
+static int nquad=0;
+static int mquad=0;
+static int queue=0;  //  PrintFlush has been called so text can be queued
+
+//
+//  Check for framebuffer objects
+//
+static int HasFBO(void)
+{
+   const char* ver = (const char*)glGetString(GL_VERSION);
+   const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+   return (ver && atoi(ver)>=3) || (ext && strstr(ext,"GL_ARB_framebuffer_object"));
+}
+
+//
+//  Render font into the atlas texture
+//
+static void BuildAtlas(void)
+{
+   atlas = 0;
+   if (!HasFBO()) return;
+   //  Cell size from the widest character
+   cw = 0;
+   for (int k=FIRST;k<=LAST;k++)
+   {
+      adv[k] = glutBitmapWidth(FONT,k);
+      if (adv[k]>cw) cw = adv[k];
+   }
+   cw += 2*PAD;
+   aw = COLS*cw;
+   ah = ((LAST-FIRST)/COLS+1)*CELLH;
+   //  Atlas texture
+   unsigned int tex;
+   glPushAttrib(GL_ALL_ATTRIB_BITS);
+   glGenTextures(1,&tex);
+   glBindTexture(GL_TEXTURE_2D,tex);
+   glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,aw,ah,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+   //  Draw the characters into it
+   int bound;
+   unsigned int fbo;
+   glGetIntegerv(GL_FRAMEBUFFER_BINDING,&bound);
+   glGenFramebuffers(1,&fbo);
+   glBindFramebuffer(GL_FRAMEBUFFER,fbo);
+   glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,tex,0);
+   if (glCheckFramebufferStatus(GL_FRAMEBUFFER)==GL_FRAMEBUFFER_COMPLETE)
+   {
+      glViewport(0,0,aw,ah);
+      glDisable(GL_DEPTH_TEST);
+      glDisable(GL_TEXTURE_2D);
+      glDisable(GL_BLEND);
+      glDisable(GL_ALPHA_TEST);
+      glDisable(GL_FOG);
+      glDisable(GL_SCISSOR_TEST);
+      glDisable(GL_STENCIL_TEST);
+      glColorMask(1,1,1,1);
+      glClearColor(0,0,0,0);
+      glClear(GL_COLOR_BUFFER_BIT);
+      glColor4f(1,1,1,1);
+      for (int k=FIRST;k<=LAST;k++)
+      {
+         glWindowPos2i((k-FIRST)%COLS*cw+PAD,(k-FIRST)/COLS*CELLH+BASE);
+         glutBitmapCharacter(FONT,k);
+      }
+      atlas = tex;
+      MemGL(MEM_TEXOBJ,tex,MEM_TEXT,4*(size_t)aw*ah);
+   }
+   else
+      glDeleteTextures(1,&tex);
+   glBindFramebuffer(GL_FRAMEBUFFER,bound);
+   glDeleteFramebuffers(1,&fbo);
+   glPopAttrib();
+}
+
+//
+//  Queue quads for the string at the current raster position
+//
+static void Queue(const char* ch)
+{
+   //  Nothing to read the raster state for
+   int n=0;
+   for (const char* c=ch;*c;c++)
+      n += (*c>=FIRST && *c<=LAST);
+   if (!n) return;
+   //  Nothing is drawn when the raster position is clipped
+   int valid;
+   glGetIntegerv(GL_CURRENT_RASTER_POSITION_VALID,&valid);
+   if (!valid) return;
+   float pos[4],col[4];
+   glGetFloatv(GL_CURRENT_RASTER_POSITION,pos);
+   glGetFloatv(GL_CURRENT_RASTER_COLOR,col);
+   unsigned char rgba[4];
+   for (int k=0;k<4;k++)
+      rgba[k] = (unsigned char)(255*col[k]+0.5);
+   //  Make room, drawing the queue when it is full
+   n *= 4;
+   if (nquad+n>MAXQUAD) PrintFlush();
+   if (nquad+n>mquad)
+   {
+      mquad = 2*(nquad+n)<MAXQUAD ? 2*(nquad+n) : MAXQUAD;
+      quad = (glyph_t*)MemRealloc(MEM_TEXT,quad,mquad*sizeof(glyph_t));
+      if (!quad) Fatal("Cannot allocate text buffer\n");
+   }
+   //  One cell sized quad per character
+   float x = pos[0];
+   for (;*ch;ch++)
+   {
+      int k = (unsigned char)*ch;
+      if (k<FIRST || k>LAST) continue;
+      float x0 = floorf(x)-PAD;
+      float y0 = floorf(pos[1])-BASE;
+      float s0 = (float)((k-FIRST)%COLS*cw)/aw;
+      float t0 = (float)((k-FIRST)/COLS*CELLH)/ah;
+      float s1 = s0+(float)cw/aw;
+      float t1 = t0+(float)CELLH/ah;
+      glyph_t v[4] = {{s0,t0,{0},x0,y0,pos[2]},{s1,t0,{0},x0+cw,y0,pos[2]},{s1,t1,{0},x0+cw,y0+CELLH,pos[2]},{s0,t1,{0},x0,y0+CELLH,pos[2]}};
+      for (int i=0;i<4;i++)
+      {
+         memcpy(v[i].rgba,rgba,4);
+         quad[nquad++] = v[i];
+      }
+      x += adv[k];
+   }
+   //  Advance the raster position past the string
+   glBitmap(0,0,0,0,x-pos[0],0,NULL);
+}
+#endif
+
 void Print(const char* format , ...)
 {
    char    buf[LEN];
@@ -17,7 +180,68 @@ void Print(const char* format , ...)
    va_start(args,format);
    vsnprintf(buf,LEN,format,args);
    va_end(args);
+#ifdef GL_VERSION_3_0
+   //  Queue the characters for PrintFlush
+   if (queue && atlas<0) BuildAtlas();
+   if (queue && atlas>0)
+   {
+      Queue(buf);
+      return;
+   }
+#endif
    //  Display the characters one at a time at the current raster position
    while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
+      glutBitmapCharacter(FONT,*ch++);
+}
+
+//
+//  Draw all text queued since the last flush
+//
+void PrintFlush(void)
+{
+#ifdef GL_VERSION_3_0
+   queue = 1;
+   if (!nquad) return;
+   //  Window coordinates map straight to pixels and depth
+   int vp[4];
+   glGetIntegerv(GL_VIEWPORT,vp);
+   glPushAttrib(GL_ENABLE_BIT|GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_TEXTURE_BIT|GL_TRANSFORM_BIT|GL_POLYGON_BIT);
+   glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+   glMatrixMode(GL_TEXTURE);
+   glPushMatrix();
+   glLoadIdentity();
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho(vp[0],vp[0]+vp[2],vp[1],vp[1]+vp[3],0,-1);
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+   glLoadIdentity();
+   //  Textured quads keep the pixels the bitmaps would set
+   glDisable(GL_LIGHTING);
+   glDisable(GL_CULL_FACE);
+   glDisable(GL_FOG);
+   glDisable(GL_TEXTURE_GEN_S);
+   glDisable(GL_TEXTURE_GEN_T);
+   glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+   glEnable(GL_TEXTURE_2D);
+   glBindTexture(GL_TEXTURE_2D,atlas);
+   glTexEnvi(GL_TEXTURE_ENV,GL_TEXTURE_ENV_MODE,GL_MODULATE);
+   glEnable(GL_ALPHA_TEST);
+   glAlphaFunc(GL_GREATER,0);
+   glDepthFunc(GL_LEQUAL);
+   //  Draw every string at once
+   glInterleavedArrays(GL_T2F_C4UB_V3F,0,quad);
+   glDrawArrays(GL_QUADS,0,nquad);
+   GlDrawCount(GL_QUADS,nquad);
+   nquad = 0;
+   //  Restore state
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_TEXTURE);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+#endif
 }
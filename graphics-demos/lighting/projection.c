@@ -2,24 +2,56 @@
 //  Willem A. (Vlakkies) Schreuder
 #include "CSCIx229.h"
 
+//  Parameters of the last projection and viewport height
+static double pfov=0;
+static double pdim=1;
+static int    pvh=1;
+
 //
 //  Set projection
 //
 void Project(double fov,double asp,double dim)
 {
+   int vp[4];
+   pfov = fov;
+   pdim = dim;
+   //  The viewport only changes on reshape, which calls Project
+   glGetIntegerv(GL_VIEWPORT,vp);
+   pvh = vp[3];
    //  Tell OpenGL we want to manipulate the projection matrix
    glMatrixMode(GL_PROJECTION);
-   //  Undo previous transformations
-   glLoadIdentity();
    //  Perspective transformation
    if (fov)
-      gluPerspective(fov,asp,dim/16,16*dim);
+      Mat4Load(Mat4Perspective(fov,asp,dim/16,16*dim));
    //  Orthogonal transformation
    else
-      glOrtho(-asp*dim,asp*dim,-dim,+dim,-dim,+dim);
+      Mat4Load(Mat4Ortho(-asp*dim,asp*dim,-dim,+dim,-dim,+dim));
    //  Switch to manipulating the model matrix
    glMatrixMode(GL_MODELVIEW);
    //  Undo previous transformations
    glLoadIdentity();
 }
 
+//
+//  Radius in pixels of a sphere of radius r at the origin of modelview
+//  matrix m, using the last Project() parameters and viewport
+//  Returns a large value when the sphere reaches the near plane
+//
+float ProjectedRadius(Mat4 m,float r)
+{
+   //  Largest scale of the modelview matrix
+   float s = 0;
+   for (int k=0;k<3;k++)
+   {
+      Vec4f c = m.c[k];
+      float l = sqrt(V4(c,0)*V4(c,0)+V4(c,1)*V4(c,1)+V4(c,2)*V4(c,2));
+      if (l>s) s = l;
+   }
+   r *= s;
+   //  Orthogonal is the same size at every distance
+   if (!pfov) return r*0.5*pvh/pdim;
+   //  Perspective shrinks with distance in front of the eye
+   float d = -V4(m.c[3],2);
+   if (d-r<=pdim/16) return 1e6;
+   return r*0.5*pvh/(d*tan(0.5*pfov*M_PI/180));
+}
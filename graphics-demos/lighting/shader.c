@@ -0,0 +1,65 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  Print shader or program log (if any) and exit on error
+//
+static void PrintLog(unsigned int obj,int program,const char* what)
+{
+   int len=0;
+   if (program)
+      glGetProgramiv(obj,GL_INFO_LOG_LENGTH,&len);
+   else
+      glGetShaderiv(obj,GL_INFO_LOG_LENGTH,&len);
+   if (len>1)
+   {
+      char* buffer = (char*)MemAlloc(MEM_TEMP,len);
+      if (!buffer) Fatal("Cannot allocate %d bytes of log for %s\n",len,what);
+      if (program)
+         glGetProgramInfoLog(obj,len,NULL,buffer);
+      else
+         glGetShaderInfoLog(obj,len,NULL,buffer);
+      fprintf(stderr,"%s:\n%s\n",what,buffer);
+      MemFree(buffer);
+   }
+   int ok;
+   if (program)
+      glGetProgramiv(obj,GL_LINK_STATUS,&ok);
+   else
+      glGetShaderiv(obj,GL_COMPILE_STATUS,&ok);
+   if (!ok) Fatal("Error %s %s\n",program?"linking":"compiling",what);
+}
+
+//
+//  Compile shader from source text
+//
+static unsigned int CreateShader(unsigned int prog,GLenum type,const char* text)
+{
+   unsigned int shader = glCreateShader(type);
+   glShaderSource(shader,1,&text,NULL);
+   glCompileShader(shader);
+   PrintLog(shader,0,type==GL_VERTEX_SHADER?"vertex shader":"fragment shader");
+   glAttachShader(prog,shader);
+   return shader;
+}
+
+//
+//  Create shader program from vertex and fragment shader source text
+//    attrib  NULL terminated attribute names bound to locations 0,1,...
+//            (NULL to let the linker choose)
+//
+unsigned int CreateShaderProg(const char* vert,const char* frag,const char* attrib[])
+{
+   unsigned int prog = glCreateProgram();
+   unsigned int vs = CreateShader(prog,GL_VERTEX_SHADER,vert);
+   unsigned int fs = CreateShader(prog,GL_FRAGMENT_SHADER,frag);
+   for (int k=0;attrib && attrib[k];k++)
+      glBindAttribLocation(prog,k,attrib[k]);
+   glLinkProgram(prog);
+   PrintLog(prog,1,"shader program");
+   //  The program keeps the shaders until it is deleted
+   glDeleteShader(vs);
+   glDeleteShader(fs);
+   return prog;
+}
@@ -0,0 +1,158 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//
+//  Startup timeline and lazy initialization
+//
+//  The clock starts before main runs.  StartupMark records the end of a
+//  startup phase (GLUT, window and context, GLEW, ...) and StartupFrame,
+//  called after every buffer swap, records the first frame once the GPU
+//  has finished it.  With -startup the timeline is printed to stderr when
+//  nothing is waiting for lazy initialization any more.
+//
+//  Meshes and textures that are not needed to show the window ask Lazy()
+//  before they are built on first use and draw without them (or with a
+//  placeholder) when it says no.  Nothing is built before the first frame
+//  and after that each frame may spend up to BUDGET ms building, so the
+//  window shows content as early as possible and fills in over the next
+//  frames.  -eager builds everything on first use instead, which shows
+//  the cost that lazy initialization spreads out.
+//
+
+#define MAXMARK 32     //  Phases recorded
+#define BUDGET  8.0    //  Build time per frame (ms)
+
+//  Phase
+typedef struct
+{
+   const char* name;   //  Phase name
+   double t;           //  End of phase (s since start)
+} mark_t;
+
+static mark_t mark[MAXMARK];
+static int    nmark=0;         //  Phases recorded
+static double t0=0;            //  Process start
+static int    print=0;         //  Print the timeline
+static int    eager=0;         //  Build everything on first use
+static int    frame=0;         //  Frames presented
+static double start=-1;        //  Start of building this frame (-1 none yet)
+static int    deferred=0;      //  Builds deferred this frame
+static int    total=0;         //  Builds deferred since startup
+static int    lazyframes=0;    //  Frames with deferred builds
+static int    done=0;          //  Timeline complete
+
+//
+//  Wall clock in seconds
+//
+static double Now(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER f,c;
+   QueryPerformanceFrequency(&f);
+   QueryPerformanceCounter(&c);
+   return (double)c.QuadPart/f.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
+
+//
+//  Start the clock before main
+//
+__attribute__ ((constructor)) static void Start(void)
+{
+   t0 = Now();
+}
+
+//
+//  Parse startup options
+//    -startup  print the startup timeline
+//    -eager    build meshes and textures as soon as they are used
+//
+void StartupInit(int argc,char* argv[])
+{
+   for (int k=1;k<argc;k++)
+   {
+      if (!strcmp(argv[k],"-startup"))
+         print = 1;
+      else if (!strcmp(argv[k],"-eager"))
+         eager = 1;
+   }
+}
+
+//
+//  Record the end of a startup phase (name must stay valid, e.g. a literal)
+//
+void StartupMark(const char* name)
+{
+   if (done || nmark>=MAXMARK) return;
+   mark[nmark].name = name;
+   mark[nmark].t = Now()-t0;
+   nmark++;
+}
+
+//
+//  Print the timeline
+//
+static void Report(void)
+{
+   fprintf(stderr,"Startup timeline (ms since process start)\n");
+   for (int k=0;k<nmark;k++)
+      fprintf(stderr,"   %-16s %9.2f  +%.2f\n",mark[k].name,1e3*mark[k].t,1e3*(mark[k].t-(k?mark[k-1].t:0)));
+   if (total)
+      fprintf(stderr,"   builds deferred %d times over %d frames\n",total,lazyframes);
+}
+
+//
+//  May a mesh or texture be built now?
+//
+int Lazy(void)
+{
+   if (eager) return 1;
+   //  Nothing before the first frame, then up to BUDGET ms per frame
+   if (frame>0)
+   {
+      double t = Now();
+      if (start<0) start = t;
+      if (1e3*(t-start)<BUDGET) return 1;
+   }
+   deferred++;
+   return 0;
+}
+
+//
+//  Call after every buffer swap
+//
+void StartupFrame(void)
+{
+   //  First frame is on screen once the GPU has finished it
+   if (frame++==0)
+   {
+      glFinish();
+      StartupMark("first frame");
+   }
+   start = -1;
+   //  Count frames that had to leave something out
+   if (deferred)
+   {
+      if (!done)
+      {
+         total += deferred;
+         lazyframes++;
+      }
+      deferred = 0;
+      return;
+   }
+   if (done) return;
+   //  Everything that was asked for is built
+   if (total) StartupMark("assets built");
+   if (print) Report();
+   done = 1;
+}
@@ -0,0 +1,239 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+//
+//  Texture cache files
+//
+//  A cache file sits next to its source (image.bmp -> image.bmp.tex) and
+//  holds a complete mip chain ready for OpenGL.  The cache is stale when
+//  the source size or modification time no longer match the header.
+//
+//  Layout (KTX-like, native byte order)
+//    header      texhdr_t below
+//    level 0..n  each level starts on a 16 byte boundary and is exactly
+//                what glTexImage2D (byte aligned GL_UNSIGNED_BYTE rows) or
+//                glCompressedTexImage2D expect for that level
+//  The file is mapped into memory and the levels are handed to OpenGL
+//  in place, so loading does no decoding or conversion at all.
+//
+
+//  Cache layout
+#define TEXMAGIC   0x43584554  //  "TEXC"
+#define TEXVERSION 2
+#define TEXALIGN   16
+#define MAXLEVEL   16
+
+//  Cache header
+typedef struct
+{
+   unsigned int magic;              //  TEXMAGIC (also catches byte order)
+   unsigned int version;            //  TEXVERSION
+   long long srcsize;               //  Source file size
+   long long srcmtime;              //  Source modification time
+   unsigned int format;             //  OpenGL internal format
+   unsigned int dx,dy;              //  Size of level 0
+   unsigned int levels;             //  Number of mip levels
+   unsigned int offset[MAXLEVEL];   //  File offset of each level
+   unsigned int size[MAXLEVEL];     //  Bytes in each level
+} texhdr_t;
+
+//
+//  Cache file name for source file
+//
+static char* CacheName(const char* file)
+{
+   char* name = (char*)MemAlloc(MEM_TEMP,strlen(file)+5);
+   if (!name) Fatal("Cannot allocate memory for cache name\n");
+   strcpy(name,file);
+   strcat(name,".tex");
+   return name;
+}
+
+//
+//  Compressed formats are uploaded with glCompressedTexImage2D
+//
+static int IsCompressed(unsigned int format)
+{
+   return format==GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format==GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+//
+//  Size of mip level l
+//
+int MipSize(int size,int l)
+{
+   size >>= l;
+   return size>1 ? size : 1;
+}
+
+//
+//  Upload mip chain to texture (0 creates a new texture)
+//
+unsigned int TexUpload(unsigned int texture,unsigned int format,int dx,int dy,int levels,unsigned char* data[],const unsigned int size[])
+{
+   //  An existing texture keeps its name and parameters and has its
+   //  levels specified again so display lists that bind it stay valid
+   int create = !texture;
+   if (create) glGenTextures(1,&texture);
+   glBindTexture(GL_TEXTURE_2D,texture);
+   glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+   glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+   size_t bytes=0;
+   for (int l=0,w=dx,h=dy;l<levels;l++)
+   {
+      bytes += size[l];
+      if (IsCompressed(format))
+         glCompressedTexImage2D(GL_TEXTURE_2D,l,format,w,h,0,size[l],data[l]);
+      else
+         glTexImage2D(GL_TEXTURE_2D,l,format,w,h,0,format,GL_UNSIGNED_BYTE,data[l]);
+      w = w>1 ? w/2 : 1;
+      h = h>1 ? h/2 : 1;
+   }
+   glPopClientAttrib();
+   //  Release levels left over from a longer mip chain
+   for (int l=levels;!create && l<MAXLEVEL;l++)
+   {
+      int w=0;
+      glGetTexLevelParameteriv(GL_TEXTURE_2D,l,GL_TEXTURE_WIDTH,&w);
+      if (!w) break;
+      glTexImage2D(GL_TEXTURE_2D,l,GL_RGBA,0,0,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+   }
+   if (glGetError()) Fatal("Error uploading texture %dx%d format %x\n",dx,dy,format);
+   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,levels-1);
+   //  Filters for a new texture, and no mipmap filter without mipmaps
+   int min=GL_LINEAR;
+   if (!create) glGetTexParameteriv(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,&min);
+   if (create || (levels==1 && min!=GL_LINEAR && min!=GL_NEAREST))
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,levels>1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+   if (create) glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+   MemGL(MEM_TEXOBJ,texture,MEM_TEXTURE,bytes);
+   return texture;
+}
+
+//
+//  Check cache header against source file and file size
+//
+static int CheckHeader(const texhdr_t* hdr,const struct stat* st,long long len,int compressed)
+{
+   if (hdr->magic!=TEXMAGIC || hdr->version!=TEXVERSION ||
+       hdr->srcsize!=(long long)st->st_size || hdr->srcmtime!=(long long)st->st_mtime ||
+       IsCompressed(hdr->format)!=compressed || hdr->levels<1 || hdr->levels>MAXLEVEL)
+      return 0;
+   for (unsigned int l=0;l<hdr->levels;l++)
+      if ((long long)hdr->offset[l]+hdr->size[l] > len) return 0;
+   return 1;
+}
+
+//
+//  Load texture from cache
+//  into texture (0 creates a new texture) dropping the top drop levels
+//  Returns 0 if there is no cache, it is stale, or holds the wrong kind
+//  of texture (compressed vs uncompressed)
+//
+unsigned int TexCacheLoad(const char* file,int compressed,unsigned int texture,int drop)
+{
+   struct stat st;
+   if (stat(file,&st)) return 0;
+   char* name = CacheName(file);
+   unsigned int tex=0;
+   unsigned char* data[MAXLEVEL];
+#ifdef _WIN32
+   //  Read levels into memory
+   FILE* f = fopen(name,"rb");
+   MemFree(name);
+   if (!f) return 0;
+   texhdr_t hdr;
+   if (fread(&hdr,sizeof(hdr),1,f)!=1 || fseek(f,0,SEEK_END) || !CheckHeader(&hdr,&st,ftell(f),compressed))
+   {
+      fclose(f);
+      return 0;
+   }
+   int ok=1;
+   for (unsigned int l=0;l<hdr.levels;l++)
+   {
+      data[l] = (unsigned char*)MemAlloc(MEM_TEXTURE,hdr.size[l]);
+      if (!data[l]) Fatal("Cannot allocate %d bytes for cached texture %s\n",hdr.size[l],file);
+      if (fseek(f,hdr.offset[l],SEEK_SET) || fread(data[l],hdr.size[l],1,f)!=1) ok = 0;
+   }
+   fclose(f);
+   if (drop>(int)hdr.levels-1) drop = hdr.levels-1;
+   if (ok) tex = TexUpload(texture,hdr.format,MipSize(hdr.dx,drop),MipSize(hdr.dy,drop),hdr.levels-drop,data+drop,hdr.size+drop);
+   for (unsigned int l=0;l<hdr.levels;l++)
+      MemFree(data[l]);
+#else
+   //  Map cache file
+   int fd = open(name,O_RDONLY);
+   MemFree(name);
+   if (fd<0) return 0;
+   struct stat cst;
+   void* map = MAP_FAILED;
+   if (!fstat(fd,&cst) && cst.st_size>=(off_t)sizeof(texhdr_t))
+      map = mmap(NULL,cst.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+   close(fd);
+   if (map==MAP_FAILED) return 0;
+   //  Upload levels straight from the mapping
+   const texhdr_t* hdr = (const texhdr_t*)map;
+   if (CheckHeader(hdr,&st,cst.st_size,compressed))
+   {
+      for (unsigned int l=0;l<hdr->levels;l++)
+         data[l] = (unsigned char*)map + hdr->offset[l];
+      if (drop>(int)hdr->levels-1) drop = hdr->levels-1;
+      tex = TexUpload(texture,hdr->format,MipSize(hdr->dx,drop),MipSize(hdr->dy,drop),hdr->levels-drop,data+drop,hdr->size+drop);
+   }
+   munmap(map,cst.st_size);
+#endif
+   return tex;
+}
+
+//
+//  Save mip chain to cache
+//  Failure to write the cache is not fatal
+//
+void TexCacheSave(const char* file,unsigned int format,int dx,int dy,int levels,unsigned char* data[],const unsigned int size[])
+{
+   struct stat st;
+   if (stat(file,&st) || levels>MAXLEVEL) return;
+   //  Fill header
+   texhdr_t hdr;
+   memset(&hdr,0,sizeof(hdr));
+   hdr.magic    = TEXMAGIC;
+   hdr.version  = TEXVERSION;
+   hdr.srcsize  = st.st_size;
+   hdr.srcmtime = st.st_mtime;
+   hdr.format   = format;
+   hdr.dx       = dx;
+   hdr.dy       = dy;
+   hdr.levels   = levels;
+   unsigned int off = sizeof(hdr);
+   for (int l=0;l<levels;l++)
+   {
+      off = (off+TEXALIGN-1)/TEXALIGN*TEXALIGN;
+      hdr.offset[l] = off;
+      hdr.size[l]   = size[l];
+      off += size[l];
+   }
+   //  Write header and levels
+   char* name = CacheName(file);
+   FILE* f = fopen(name,"wb");
+   if (!f)
+      fprintf(stderr,"Cannot write texture cache %s\n",name);
+   else
+   {
+      int ok = fwrite(&hdr,sizeof(hdr),1,f)==1;
+      for (int l=0;l<levels && ok;l++)
+         ok = !fseek(f,hdr.offset[l],SEEK_SET) && fwrite(data[l],size[l],1,f)==1;
+      if (fclose(f) || !ok)
+      {
+         fprintf(stderr,"Error writing texture cache %s\n",name);
+         remove(name);
+      }
+   }
+   MemFree(name);
+}
@@ -0,0 +1,251 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  CPU block compression to BC1 (DXT1) and BC3 (DXT5)
+//
+//  Each 4x4 block is fit along its principal color axis (power iteration on
+//  the covariance matrix) and every pixel picks the nearest of the four
+//  palette colors.  BC3 adds an eight level alpha ramp between the block's
+//  alpha extremes.  Rows of blocks are spread across all cores.
+//
+
+//  Per image encoder state
+typedef struct
+{
+   const unsigned char* image;  //  RGB or RGBA pixels
+   int dx,dy;                   //  Image size
+   int ncomp;                   //  Components per pixel
+   int bsize;                   //  Bytes per block (8=BC1 16=BC3)
+   unsigned char* out;          //  Compressed blocks
+} bcjob_t;
+
+//
+//  Quantize color to 5:6:5
+//
+static unsigned short To565(const float c[3])
+{
+   int r = (int)(c[0]*31/255+0.5);
+   int g = (int)(c[1]*63/255+0.5);
+   int b = (int)(c[2]*31/255+0.5);
+   return r<<11 | g<<5 | b;
+}
+
+//
+//  Expand 5:6:5 color to 0-255
+//
+static void From565(unsigned short c,float rgb[3])
+{
+   int r = (c>>11)&31;
+   int g = (c>>5)&63;
+   int b = c&31;
+   rgb[0] = (r<<3)|(r>>2);
+   rgb[1] = (g<<2)|(g>>4);
+   rgb[2] = (b<<3)|(b>>2);
+}
+
+//
+//  Clamp to 0-255
+//
+static float Clamp255(float x)
+{
+   return x<0 ? 0 : x>255 ? 255 : x;
+}
+
+//
+//  Encode 16 pixels as a BC1 color block
+//
+static void EncodeColor(float px[16][4],unsigned char out[8])
+{
+   //  Mean color
+   float m[3] = {0,0,0};
+   for (int i=0;i<16;i++)
+      for (int k=0;k<3;k++)
+         m[k] += px[i][k]/16;
+   //  Covariance
+   float c[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+   for (int i=0;i<16;i++)
+   {
+      float d[3] = {px[i][0]-m[0],px[i][1]-m[1],px[i][2]-m[2]};
+      for (int j=0;j<3;j++)
+         for (int k=0;k<3;k++)
+            c[j][k] += d[j]*d[k];
+   }
+   //  Principal axis by power iteration
+   float v[3] = {1,1,1};
+   for (int it=0;it<4;it++)
+   {
+      float w[3];
+      for (int j=0;j<3;j++)
+         w[j] = c[j][0]*v[0] + c[j][1]*v[1] + c[j][2]*v[2];
+      float l = sqrtf(w[0]*w[0]+w[1]*w[1]+w[2]*w[2]);
+      if (l<1e-6) {v[0] = v[1] = v[2] = 0; break;}
+      for (int j=0;j<3;j++)
+         v[j] = w[j]/l;
+   }
+   //  Extent of the block along the axis
+   float lo=0,hi=0;
+   for (int i=0;i<16;i++)
+   {
+      float t = (px[i][0]-m[0])*v[0] + (px[i][1]-m[1])*v[1] + (px[i][2]-m[2])*v[2];
+      if (t<lo) lo = t;
+      if (t>hi) hi = t;
+   }
+   float e0[3],e1[3];
+   for (int k=0;k<3;k++)
+   {
+      e0[k] = Clamp255(m[k]+hi*v[k]);
+      e1[k] = Clamp255(m[k]+lo*v[k]);
+   }
+   //  Endpoints in descending order selects four color mode
+   unsigned short c0 = To565(e0);
+   unsigned short c1 = To565(e1);
+   if (c0<c1)
+   {
+      unsigned short t = c0;
+      c0 = c1;
+      c1 = t;
+   }
+   //  Palette as the decoder will see it
+   float pal[4][3];
+   From565(c0,pal[0]);
+   From565(c1,pal[1]);
+   for (int k=0;k<3;k++)
+   {
+      pal[2][k] = (2*pal[0][k]+pal[1][k])/3;
+      pal[3][k] = (pal[0][k]+2*pal[1][k])/3;
+   }
+   //  Nearest palette entry for each pixel
+   unsigned int bits=0;
+   if (c0!=c1)
+      for (int i=0;i<16;i++)
+      {
+         int best=0;
+         float dmin=1e30;
+         for (int j=0;j<4;j++)
+         {
+            float dr = px[i][0]-pal[j][0];
+            float dg = px[i][1]-pal[j][1];
+            float db = px[i][2]-pal[j][2];
+            float d = dr*dr+dg*dg+db*db;
+            if (d<dmin)
+            {
+               dmin = d;
+               best = j;
+            }
+         }
+         bits |= best<<(2*i);
+      }
+   out[0] = c0;
+   out[1] = c0>>8;
+   out[2] = c1;
+   out[3] = c1>>8;
+   for (int k=0;k<4;k++)
+      out[4+k] = bits>>(8*k);
+}
+
+//
+//  Encode 16 alphas as a BC3 alpha block
+//
+static void EncodeAlpha(float px[16][4],unsigned char out[8])
+{
+   //  Alpha extremes
+   int a0=0,a1=255;
+   for (int i=0;i<16;i++)
+   {
+      if (px[i][3]>a0) a0 = px[i][3];
+      if (px[i][3]<a1) a1 = px[i][3];
+   }
+   //  Eight level ramp from a0 (index 0) to a1 (index 1)
+   unsigned long long bits=0;
+   if (a0>a1)
+      for (int i=0;i<16;i++)
+      {
+         int p = (int)((a0-px[i][3])*7/(a0-a1)+0.5);
+         unsigned long long idx = (p==0) ? 0 : (p==7) ? 1 : p+1;
+         bits |= idx<<(3*i);
+      }
+   out[0] = a0;
+   out[1] = a1;
+   for (int k=0;k<6;k++)
+      out[2+k] = bits>>(8*k);
+}
+
+//
+//  Encode one row of blocks
+//
+static void EncodeRow(int by,void* arg)
+{
+   bcjob_t* job = (bcjob_t*)arg;
+   int nbx = (job->dx+3)/4;
+   unsigned char* out = job->out + by*nbx*job->bsize;
+   for (int bx=0;bx<nbx;bx++,out+=job->bsize)
+   {
+      //  Gather block, clamping at the image edge
+      float px[16][4];
+      for (int j=0;j<4;j++)
+      {
+         int y = 4*by+j<job->dy ? 4*by+j : job->dy-1;
+         for (int i=0;i<4;i++)
+         {
+            int x = 4*bx+i<job->dx ? 4*bx+i : job->dx-1;
+            const unsigned char* p = job->image + job->ncomp*(y*job->dx+x);
+            px[4*j+i][0] = p[0];
+            px[4*j+i][1] = p[1];
+            px[4*j+i][2] = p[2];
+            px[4*j+i][3] = job->ncomp==4 ? p[3] : 255;
+         }
+      }
+      //  BC3 is alpha block followed by color block
+      if (job->bsize==16)
+      {
+         EncodeAlpha(px,out);
+         EncodeColor(px,out+8);
+      }
+      else
+         EncodeColor(px,out);
+   }
+}
+
+//
+//  Compress image to BC1 (ncomp=3) or BC3 (ncomp=4)
+//  Returns blocks from MemAlloc and sets size to the number of bytes
+//
+unsigned char* CompressBC(const unsigned char* image,int dx,int dy,int ncomp,unsigned int* size)
+{
+   bcjob_t job = {image,dx,dy,ncomp,ncomp==4 ? 16 : 8,NULL};
+   int nby = (dy+3)/4;
+   *size = ((dx+3)/4)*nby*job.bsize;
+   job.out = (unsigned char*)MemAlloc(MEM_TEXTURE,*size);
+   if (!job.out) Fatal("Cannot allocate %d bytes for compressed image\n",*size);
+   Parallel(nby,EncodeRow,&job);
+   return job.out;
+}
+
+//
+//  Box filter image to half size (next mip level)
+//  Returns image from MemAlloc and sets the new size
+//
+unsigned char* HalveImage(const unsigned char* image,int dx,int dy,int ncomp,int* DX,int* DY)
+{
+   int nx = dx>1 ? dx/2 : 1;
+   int ny = dy>1 ? dy/2 : 1;
+   unsigned char* half = (unsigned char*)MemAlloc(MEM_TEXTURE,nx*ny*ncomp);
+   if (!half) Fatal("Cannot allocate %d bytes for mip level\n",nx*ny*ncomp);
+   for (int j=0;j<ny;j++)
+   {
+      const unsigned char* r0 = image + ncomp*dx*(2*j<dy ? 2*j : dy-1);
+      const unsigned char* r1 = image + ncomp*dx*(2*j+1<dy ? 2*j+1 : dy-1);
+      for (int i=0;i<nx;i++)
+      {
+         int i0 = ncomp*(2*i<dx ? 2*i : dx-1);
+         int i1 = ncomp*(2*i+1<dx ? 2*i+1 : dx-1);
+         for (int k=0;k<ncomp;k++)
+            half[ncomp*(j*nx+i)+k] = (r0[i0+k]+r0[i1+k]+r1[i0+k]+r1[i1+k]+2)/4;
+      }
+   }
+   *DX = nx;
+   *DY = ny;
+   return half;
+}
@@ -0,0 +1,225 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  Texture residency manager
+//
+//  Every texture loaded by LoadTexBMP is recorded here with its size in
+//  bytes and the frame it was last bound with TexBind (or marked with
+//  TexTouch).  TexFrame enforces the budget set with TexBudget:
+//    over budget   the least recently used texture loses its top mip level
+//                  (its resolution is halved) and once it is down to 1x1
+//                  it is evicted to a single placeholder texel
+//    under budget  textures used in the last frame are streamed back one
+//                  level per frame while the budget allows
+//  Textures keep their names throughout, so display lists stay valid.
+//  Textures bound inside display lists must be marked with TexTouch, or
+//  recorded for the list with TexList and the list drawn with TexCallList.
+//
+
+//  Texture record
+typedef struct
+{
+   char* file;          //  Source file (NULL when not managed)
+   int maxdrop;         //  Halvings from full size to 1x1
+   int drop;            //  Halvings now resident (-1 = evicted)
+   size_t bytes;        //  Bytes resident now
+   size_t size[32];     //  Bytes at each drop (0=not seen yet)
+   unsigned int used;   //  Frame last used
+} texent_t;
+
+//  Textures indexed by name
+static texent_t* tex=NULL;
+static unsigned int ntex=0;
+//  Budget, resident bytes and frame counter
+static size_t budget=0;
+static size_t resident=0;
+static unsigned int frame=1;
+
+//  Textures bound by display lists
+typedef struct
+{
+   unsigned int list;   //  Display list
+   int n;               //  Number of textures
+   unsigned int* tex;   //  Textures
+} texlist_t;
+static texlist_t* lists=NULL;
+static int nlists=0;
+
+//
+//  Bytes used by the texture bound to GL_TEXTURE_2D
+//
+static size_t TexBytes(void)
+{
+   size_t bytes=0;
+   int max,comp,fmt,w,h;
+   glGetTexParameteriv(GL_TEXTURE_2D,GL_TEXTURE_MAX_LEVEL,&max);
+   for (int l=0;l<=max;l++)
+   {
+      glGetTexLevelParameteriv(GL_TEXTURE_2D,l,GL_TEXTURE_WIDTH,&w);
+      if (!w) break;
+      glGetTexLevelParameteriv(GL_TEXTURE_2D,l,GL_TEXTURE_HEIGHT,&h);
+      glGetTexLevelParameteriv(GL_TEXTURE_2D,l,GL_TEXTURE_COMPRESSED,&comp);
+      if (comp)
+      {
+         glGetTexLevelParameteriv(GL_TEXTURE_2D,l,GL_TEXTURE_COMPRESSED_IMAGE_SIZE,&comp);
+         bytes += comp;
+      }
+      else
+      {
+         glGetTexLevelParameteriv(GL_TEXTURE_2D,l,GL_TEXTURE_INTERNAL_FORMAT,&fmt);
+         bytes += (size_t)w*h*(fmt==GL_RGBA || fmt==GL_RGBA8 ? 4 : 3);
+      }
+   }
+   return bytes;
+}
+
+//
+//  Reload texture k at a new resolution (-1 = evict)
+//
+static void Restream(unsigned int k,int drop)
+{
+   int bound;
+   glGetIntegerv(GL_TEXTURE_BINDING_2D,&bound);
+   //  Evict to a single gray texel
+   if (drop<0)
+   {
+      unsigned char gray[] = {128,128,128};
+      unsigned char* data = gray;
+      unsigned int size = 3;
+      TexUpload(k,GL_RGB,1,1,1,&data,&size);
+   }
+   //  Reload from source
+   else
+      TexReload(k,tex[k].file,drop);
+   resident -= tex[k].bytes;
+   tex[k].bytes = TexBytes();
+   tex[k].drop  = drop;
+   if (drop>=0) tex[k].size[drop] = tex[k].bytes;
+   resident += tex[k].bytes;
+   glBindTexture(GL_TEXTURE_2D,bound);
+}
+
+//
+//  Start managing texture loaded from file
+//  (the texture must be bound to GL_TEXTURE_2D)
+//
+void TexManage(unsigned int texture,const char* file)
+{
+   //  Grow table to cover this name
+   if (texture>=ntex)
+   {
+      unsigned int n = texture+64;
+      tex = (texent_t*)MemRealloc(MEM_TEXTURE,tex,n*sizeof(texent_t));
+      if (!tex) Fatal("Cannot allocate texture table\n");
+      memset(tex+ntex,0,(n-ntex)*sizeof(texent_t));
+      ntex = n;
+   }
+   //  Record source, size and resolution
+   texent_t* t = tex+texture;
+   MemFree(t->file);
+   resident -= t->bytes;
+   t->file = (char*)MemAlloc(MEM_TEXTURE,strlen(file)+1);
+   if (!t->file) Fatal("Cannot allocate memory for texture name %s\n",file);
+   strcpy(t->file,file);
+   int w,h;
+   glGetTexLevelParameteriv(GL_TEXTURE_2D,0,GL_TEXTURE_WIDTH,&w);
+   glGetTexLevelParameteriv(GL_TEXTURE_2D,0,GL_TEXTURE_HEIGHT,&h);
+   for (t->maxdrop=0;(w>>t->maxdrop)>1 || (h>>t->maxdrop)>1;t->maxdrop++);
+   t->drop  = 0;
+   t->bytes = TexBytes();
+   memset(t->size,0,sizeof(t->size));
+   t->size[0] = t->bytes;
+   t->used  = frame;
+   resident += t->bytes;
+}
+
+//
+//  Mark texture as used this frame
+//
+void TexTouch(unsigned int texture)
+{
+   if (texture<ntex) tex[texture].used = frame;
+}
+
+//
+//  Bind texture and mark it as used
+//
+void TexBind(unsigned int texture)
+{
+   glBindTexture(GL_TEXTURE_2D,texture);
+   TexTouch(texture);
+}
+
+//
+//  Record the n textures display list binds
+//
+void TexList(unsigned int list,int n,const unsigned int texture[])
+{
+   lists = (texlist_t*)MemRealloc(MEM_TEXTURE,lists,(nlists+1)*sizeof(texlist_t));
+   if (!lists) Fatal("Cannot allocate texture lists\n");
+   texlist_t* l = lists+nlists++;
+   l->list = list;
+   l->n = n;
+   l->tex = (unsigned int*)MemAlloc(MEM_TEXTURE,n*sizeof(unsigned int));
+   if (n && !l->tex) Fatal("Cannot allocate texture list\n");
+   memcpy(l->tex,texture,n*sizeof(unsigned int));
+}
+
+//
+//  Call display list and mark the textures it binds as used
+//
+void TexCallList(unsigned int list)
+{
+   for (int k=0;k<nlists;k++)
+      if (lists[k].list==list)
+         for (int i=0;i<lists[k].n;i++)
+            TexTouch(lists[k].tex[i]);
+   glCallList(list);
+}
+
+//
+//  Set texture memory budget in bytes (0=unlimited)
+//
+void TexBudget(size_t bytes)
+{
+   budget = bytes;
+}
+
+//
+//  Resident and budget bytes
+//
+void TexMemory(size_t* res,size_t* bud)
+{
+   if (res) *res = resident;
+   if (bud) *bud = budget;
+}
+
+//
+//  Enforce budget - call once per frame before drawing
+//
+void TexFrame(void)
+{
+   frame++;
+   if (!budget) return;
+   //  Shrink least recently used textures until under budget
+   while (resident>budget)
+   {
+      int k=-1;
+      for (unsigned int i=0;i<ntex;i++)
+         if (tex[i].file && tex[i].drop>=0 && (k<0 || tex[i].used<tex[k].used))
+            k = i;
+      if (k<0) break;
+      Restream(k,tex[k].drop<tex[k].maxdrop ? tex[k].drop+1 : -1);
+   }
+   //  Bring back one level of textures used last frame if it fits
+   //  (each level up is about four times the size until it has been seen)
+   for (unsigned int i=0;i<ntex;i++)
+      if (tex[i].file && tex[i].drop && tex[i].used+1>=frame)
+      {
+         int drop = tex[i].drop<0 ? tex[i].maxdrop : tex[i].drop-1;
+         size_t need = tex[i].size[drop] ? tex[i].size[drop] : tex[i].drop<0 ? tex[i].bytes : 4*tex[i].bytes;
+         if (resident-tex[i].bytes+need<=budget) Restream(i,drop);
+      }
+}
@@ -0,0 +1,386 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+//
+//  Tiled textures for images larger than GL_MAX_TEXTURE_SIZE
+//
+//  The BMP file (uncompressed 24 or 32 bit) is mapped into memory and
+//  never read as a whole.  Every mip level is cut into PAGE x PAGE pages
+//  (PIN source texels plus a one texel border so filtering is seamless).
+//  Each frame the page quadtree is walked from the coarsest level down:
+//  pages outside the view frustum are skipped and a page is refined until
+//  its texels are no larger than a screen pixel.  Only the pages drawn are
+//  made resident in a fixed pool of MAXPAGE textures, evicting the least
+//  recently used page.  At most MAXLOAD pages are streamed per frame; a
+//  page that has to wait is drawn from its nearest resident ancestor.
+//  Coarse levels sample the 2x2 texels at the center of each footprint so
+//  filling any page touches the same number of source pixels.
+//  Memory used is therefore bounded no matter how large the image is.
+//  32 bit images keep their alpha unless the coarsest page shows the alpha
+//  bytes are unused (all zero), as in most XRGB files.
+//
+
+#define PAGE    256       //  Page texture size
+#define PIN     (PAGE-2)  //  Source texels per page
+#define MAXPAGE 96        //  Resident pages
+#define MAXLOAD 8         //  Pages streamed per frame
+
+//  Resident page
+typedef struct
+{
+   int level,px,py;     //  Page key (level<0 = free)
+   unsigned int tex;    //  Texture
+   unsigned int used;   //  Frame last used
+} page_t;
+
+//  Tiled image
+struct tiled_s
+{
+   unsigned char* map;         //  Mapped file
+   size_t mapsize;             //  Size of mapping
+   const unsigned char* pix;   //  Start of pixel data
+   int dx,dy;                  //  Image size
+   int ncomp;                  //  Bytes per pixel (3 or 4)
+   int alpha;                  //  Pages have an alpha channel
+   int stride;                 //  Bytes per row
+   int topdown;                //  Rows are stored top to bottom
+   int top;                    //  Coarsest level (one page)
+   page_t page[MAXPAGE];       //  Page pool
+   unsigned int frame;         //  Frame counter
+   int loads;                  //  Pages streamed this frame
+   unsigned char* buf;         //  Page fill buffer
+   double M[16];               //  Projection x modelview
+   int vp[4];                  //  Viewport
+   double x0,z0,x1,z1,y;       //  World rectangle
+#ifdef _WIN32
+   HANDLE file,mapping;        //  File and mapping handles
+#endif
+};
+
+//
+//  Map file into memory
+//
+static void MapFile(tiled_t* t,const char* file)
+{
+#ifdef _WIN32
+   t->file = CreateFileA(file,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,0,NULL);
+   if (t->file==INVALID_HANDLE_VALUE) Fatal("Cannot open file %s\n",file);
+   LARGE_INTEGER size;
+   GetFileSizeEx(t->file,&size);
+   t->mapsize = size.QuadPart;
+   t->mapping = CreateFileMappingA(t->file,NULL,PAGE_READONLY,0,0,NULL);
+   t->map = t->mapping ? (unsigned char*)MapViewOfFile(t->mapping,FILE_MAP_READ,0,0,0) : NULL;
+   if (!t->map) Fatal("Cannot map file %s\n",file);
+#else
+   int fd = open(file,O_RDONLY);
+   struct stat st;
+   if (fd<0 || fstat(fd,&st)) Fatal("Cannot open file %s\n",file);
+   t->mapsize = st.st_size;
+   t->map = (unsigned char*)mmap(NULL,t->mapsize,PROT_READ,MAP_PRIVATE,fd,0);
+   close(fd);
+   if (t->map==MAP_FAILED) Fatal("Cannot map file %s\n",file);
+#endif
+}
+
+//
+//  Pointer to source pixel (clamped to the image)
+//
+static const unsigned char* Pixel(const tiled_t* t,int x,int y)
+{
+   x = x<0 ? 0 : x>=t->dx ? t->dx-1 : x;
+   y = y<0 ? 0 : y>=t->dy ? t->dy-1 : y;
+   if (t->topdown) y = t->dy-1-y;
+   return t->pix + (size_t)y*t->stride + (size_t)x*t->ncomp;
+}
+
+//
+//  Fill page buffer with page (px,py) of level L
+//
+static void FillPage(tiled_t* t,int L,int px,int py)
+{
+   int s = 1<<L;
+   int c = s/2-1;
+   unsigned char* out = t->buf;
+   for (int j=0;j<PAGE;j++)
+   {
+      int v = py*PIN+j-1;
+      for (int i=0;i<PAGE;i++,out+=t->ncomp)
+      {
+         int u = px*PIN+i-1;
+         //  Full resolution
+         if (!L)
+            memcpy(out,Pixel(t,u,v),t->ncomp);
+         //  Average of the 2x2 texels at the center of the footprint
+         else
+         {
+            const unsigned char* p00 = Pixel(t,u*s+c  ,v*s+c  );
+            const unsigned char* p10 = Pixel(t,u*s+c+1,v*s+c  );
+            const unsigned char* p01 = Pixel(t,u*s+c  ,v*s+c+1);
+            const unsigned char* p11 = Pixel(t,u*s+c+1,v*s+c+1);
+            for (int k=0;k<t->ncomp;k++)
+               out[k] = (p00[k]+p10[k]+p01[k]+p11[k]+2)/4;
+         }
+      }
+   }
+}
+
+//
+//  Find resident page (NULL if not resident)
+//
+static page_t* FindPage(tiled_t* t,int L,int px,int py)
+{
+   for (int k=0;k<MAXPAGE;k++)
+   {
+      page_t* p = t->page+k;
+      if (p->level==L && p->px==px && p->py==py)
+      {
+         p->used = t->frame;
+         return p;
+      }
+   }
+   return NULL;
+}
+
+//
+//  Make page resident
+//  Returns NULL when the stream budget for this frame is used up or every
+//  page in the pool is needed this frame
+//
+static page_t* LoadPage(tiled_t* t,int L,int px,int py)
+{
+   page_t* p = FindPage(t,L,px,py);
+   if (p || t->loads>=MAXLOAD) return p;
+   //  Least recently used page not needed this frame (the top page stays)
+   for (int k=0;k<MAXPAGE;k++)
+   {
+      page_t* q = t->page+k;
+      if (q->level!=t->top && q->used!=t->frame && (!p || q->used<p->used))
+         p = q;
+   }
+   if (!p) return NULL;
+   //  Allocate texture on first use
+   if (!p->tex)
+   {
+      glGenTextures(1,&p->tex);
+      glBindTexture(GL_TEXTURE_2D,p->tex);
+      if (t->alpha)
+         glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,PAGE,PAGE,0,GL_RGBA,GL_UNSIGNED_BYTE,NULL);
+      else
+         glTexImage2D(GL_TEXTURE_2D,0,GL_RGB8,PAGE,PAGE,0,GL_RGB,GL_UNSIGNED_BYTE,NULL);
+      MemGL(MEM_TEXOBJ,p->tex,MEM_TEXTURE,(t->alpha?4:3)*PAGE*PAGE);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+   }
+   //  Stream page
+   FillPage(t,L,px,py);
+   glBindTexture(GL_TEXTURE_2D,p->tex);
+   glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+   glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+   glTexSubImage2D(GL_TEXTURE_2D,0,0,0,PAGE,PAGE,t->ncomp==4 ? GL_BGRA : GL_BGR,GL_UNSIGNED_BYTE,t->buf);
+   glPopClientAttrib();
+   p->level = L;
+   p->px    = px;
+   p->py    = py;
+   p->used  = t->frame;
+   t->loads++;
+   return p;
+}
+
+//
+//  Open tiled texture from BMP file
+//
+tiled_t* LoadTiledBMP(const char* file)
+{
+   tiled_t* t = (tiled_t*)MemCalloc(MEM_TEXTURE,1,sizeof(tiled_t));
+   if (!t) Fatal("Cannot allocate tiled texture %s\n",file);
+   long off;
+   if (!BMPLayout(file,&t->dx,&t->dy,&t->ncomp,&off,&t->stride,&t->topdown))
+      Fatal("%s tiled textures must be uncompressed 24 or 32 bit\n",file);
+   MapFile(t,file);
+   if (off+(size_t)t->stride*t->dy > t->mapsize) Fatal("%s is truncated\n",file);
+   t->pix = t->map+off;
+   //  Coarsest level fits on one page
+   while (((t->dx-1)>>t->top)+1>PIN || ((t->dy-1)>>t->top)+1>PIN)
+      t->top++;
+   //  Page pool and fill buffer
+   for (int k=0;k<MAXPAGE;k++)
+      t->page[k].level = -1;
+   t->frame = 1;
+   t->buf = (unsigned char*)MemAlloc(MEM_TEXTURE,PAGE*PAGE*t->ncomp);
+   if (!t->buf) Fatal("Cannot allocate page buffer for %s\n",file);
+   //  Alpha is used if any texel of the coarsest page has it
+   if (t->ncomp==4)
+   {
+      FillPage(t,t->top,0,0);
+      for (int k=3;k<PAGE*PAGE*4 && !t->alpha;k+=4)
+         t->alpha = t->buf[k]!=0;
+   }
+   //  The top page is always resident
+   LoadPage(t,t->top,0,0);
+   return t;
+}
+
+//
+//  Source texel to clip coordinates
+//
+static void Clip(const tiled_t* t,double u,double v,double c[4])
+{
+   double x = t->x0 + (t->x1-t->x0)*u/t->dx;
+   double z = t->z0 + (t->z1-t->z0)*v/t->dy;
+   for (int i=0;i<4;i++)
+      c[i] = t->M[i]*x + t->M[4+i]*t->y + t->M[8+i]*z + t->M[12+i];
+}
+
+//
+//  Screen size in pixels of source rectangle
+//  Returns -1 if it is outside the view frustum
+//
+static double ScreenSize(const tiled_t* t,double u0,double v0,double u1,double v1)
+{
+   double c[4][4];
+   Clip(t,u0,v0,c[0]);
+   Clip(t,u1,v0,c[1]);
+   Clip(t,u1,v1,c[2]);
+   Clip(t,u0,v1,c[3]);
+   //  Outside if all corners are beyond the same clip plane
+   for (int i=0;i<3;i++)
+   {
+      int lo=0,hi=0;
+      for (int k=0;k<4;k++)
+      {
+         if (c[k][i]<-c[k][3]) lo++;
+         if (c[k][i]>+c[k][3]) hi++;
+      }
+      if (lo==4 || hi==4) return -1;
+   }
+   //  Crossing the eye plane is treated as very large
+   double sx[4],sy[4];
+   for (int k=0;k<4;k++)
+   {
+      if (c[k][3]<1e-6) return 1e30;
+      sx[k] = 0.5*t->vp[2]*c[k][0]/c[k][3];
+      sy[k] = 0.5*t->vp[3]*c[k][1]/c[k][3];
+   }
+   //  Longest edge
+   double size=0;
+   for (int k=0;k<4;k++)
+   {
+      double l = hypot(sx[(k+1)%4]-sx[k],sy[(k+1)%4]-sy[k]);
+      if (l>size) size = l;
+   }
+   return size;
+}
+
+//
+//  Draw source rectangle using page p
+//
+static void Quad(const tiled_t* t,const page_t* p,double u0,double v0,double u1,double v1)
+{
+   //  Source texels to page texture coordinates
+   double s = 1<<p->level;
+   double s0 = (1+u0/s-p->px*PIN)/PAGE, s1 = (1+u1/s-p->px*PIN)/PAGE;
+   double t0 = (1+v0/s-p->py*PIN)/PAGE, t1 = (1+v1/s-p->py*PIN)/PAGE;
+   double x0 = t->x0 + (t->x1-t->x0)*u0/t->dx, x1 = t->x0 + (t->x1-t->x0)*u1/t->dx;
+   double z0 = t->z0 + (t->z1-t->z0)*v0/t->dy, z1 = t->z0 + (t->z1-t->z0)*v1/t->dy;
+   glBindTexture(GL_TEXTURE_2D,p->tex);
+   glBegin(GL_QUADS);
+   glTexCoord2d(s0,t0); glVertex3d(x0,t->y,z0);
+   glTexCoord2d(s0,t1); glVertex3d(x0,t->y,z1);
+   glTexCoord2d(s1,t1); glVertex3d(x1,t->y,z1);
+   glTexCoord2d(s1,t0); glVertex3d(x1,t->y,z0);
+   glEnd();
+   GlDrawCount(GL_QUADS,4);
+}
+
+//
+//  Draw page (px,py) of level L refining as needed
+//  anc is the nearest resident ancestor
+//
+static void DrawPage(tiled_t* t,int L,int px,int py,const page_t* anc)
+{
+   //  Source rectangle covered by this page
+   int s = 1<<L;
+   double u0 = (double)px*PIN*s, u1 = fmin(u0+PIN*s,t->dx);
+   double v0 = (double)py*PIN*s, v1 = fmin(v0+PIN*s,t->dy);
+   double size = ScreenSize(t,u0,v0,u1,v1);
+   if (size<0) return;
+   //  Refine when page texels would be larger than pixels
+   if (L>0 && size>PIN)
+   {
+      const page_t* p = FindPage(t,L,px,py);
+      if (p) anc = p;
+      for (int j=0;j<2;j++)
+         for (int i=0;i<2;i++)
+            if ((2*px+i)*PIN*(s/2)<t->dx && (2*py+j)*PIN*(s/2)<t->dy)
+               DrawPage(t,L-1,2*px+i,2*py+j,anc);
+   }
+   //  Draw this page (or its ancestor while it streams in)
+   else
+   {
+      const page_t* p = LoadPage(t,L,px,py);
+      Quad(t,p?p:anc,u0,v0,u1,v1);
+   }
+}
+
+//
+//  Draw tiled texture on the rectangle (x0,z0)-(x1,z1) at height y
+//  Image column 0 is at x0 and the bottom row at z0
+//
+void DrawTiled(tiled_t* t,double x0,double z0,double x1,double z1,double y)
+{
+   //  Combined projection and modelview matrix
+   double P[16],V[16];
+   glGetDoublev(GL_PROJECTION_MATRIX,P);
+   glGetDoublev(GL_MODELVIEW_MATRIX,V);
+   for (int i=0;i<4;i++)
+      for (int j=0;j<4;j++)
+         t->M[4*j+i] = P[i]*V[4*j] + P[4+i]*V[4*j+1] + P[8+i]*V[4*j+2] + P[12+i]*V[4*j+3];
+   glGetIntegerv(GL_VIEWPORT,t->vp);
+   t->x0 = x0;
+   t->z0 = z0;
+   t->x1 = x1;
+   t->z1 = z1;
+   t->y  = y;
+   //  New frame
+   t->frame++;
+   t->loads = 0;
+   //  Walk pages from the top
+   glPushAttrib(GL_ENABLE_BIT|GL_TEXTURE_BIT);
+   glEnable(GL_TEXTURE_2D);
+   glNormal3f(0,1,0);
+   DrawPage(t,t->top,0,0,FindPage(t,t->top,0,0));
+   glPopAttrib();
+}
+
+//
+//  Release tiled texture
+//
+void FreeTiled(tiled_t* t)
+{
+   for (int k=0;k<MAXPAGE;k++)
+      if (t->page[k].tex)
+      {
+         glDeleteTextures(1,&t->page[k].tex);
+         MemGL(MEM_TEXOBJ,t->page[k].tex,MEM_TEXTURE,0);
+      }
+#ifdef _WIN32
+   UnmapViewOfFile(t->map);
+   CloseHandle(t->mapping);
+   CloseHandle(t->file);
+#else
+   munmap(t->map,t->mapsize);
+#endif
+   MemFree(t->buf);
+   MemFree(t);
+}
@@ -0,0 +1,276 @@
+//  CSCIx229 library
+//  Willem A. (Vlakkies) Schreuder
+#include "CSCIx229.h"
+
+//
+//  CPU trace
+//
+//  TraceScope("name") at the top of a block times the block: the start
+//  time is kept in a local variable and the cleanup attribute records the
+//  event when the block exits, however it exits.  Each thread writes to
+//  its own ring buffer, so recording takes no locks and the oldest events
+//  are overwritten.  When a thread exits its ring is handed to the next
+//  new thread, so the short lived workers of Parallel share a few rings.
+//  TraceFrame marks the end of a frame and -trace FILE writes the last
+//  frames (120, or -traceframes N) at exit as Chrome trace_event JSON
+//  that chrome://tracing and Perfetto can open.
+//  Time spent in each scope name is also summed over all threads and
+//  TraceStat reports the average per frame over the last PERIOD frames.
+//
+//  Everything is compiled out unless the library and program are built
+//  with -DTRACE, e.g.  make CFLG="-O3 -Wall -DTRACE"
+//
+#ifdef TRACE
+#include <time.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define RING     16384   //  Events per thread (power of two)
+#define MAXFRAME 1024    //  Frame marks kept
+#define MAXSTAT  32      //  Scope names summed
+#define PERIOD   30      //  Frames per average
+
+//  Recorded scope
+typedef struct
+{
+   const char* name;   //  Scope name
+   long long t0,t1;    //  Start and end (ns)
+} traceevent_t;
+
+//  Ring buffer for one thread
+typedef struct tracering_s
+{
+   traceevent_t ev[RING];     //  Events
+   unsigned int n;            //  Events written
+   int tid;                   //  Thread number
+   int idle;                  //  Thread exited (ring can be reused)
+   struct tracering_s* next;  //  Next ring
+} tracering_t;
+
+static tracering_t* rings=NULL;        //  All rings
+static __thread tracering_t* ring=NULL; //  This thread's ring
+static int nring=0;                    //  Number of rings
+static pthread_key_t key;              //  Releases the ring at thread exit
+static pthread_once_t once=PTHREAD_ONCE_INIT;
+static long long mark[MAXFRAME];       //  End of frame times
+static unsigned int nmark=0;           //  Frames marked
+static const char* dump=NULL;          //  Trace file
+static int dumpframes=120;             //  Frames to write
+
+//  Time per scope name
+typedef struct
+{
+   const char* name;   //  Scope name
+   long long sum;      //  Time this period (ns)
+   double ms;          //  Average per frame last period (ms)
+} tracestat_t;
+static tracestat_t stat[MAXSTAT];
+static int nstat=0;                    //  Names in use
+
+//
+//  Monotonic time in nanoseconds
+//
+static long long Nanos(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER f,c;
+   QueryPerformanceFrequency(&f);
+   QueryPerformanceCounter(&c);
+   return (long long)(c.QuadPart*(1e9/f.QuadPart));
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return ts.tv_sec*1000000000LL + ts.tv_nsec;
+#endif
+}
+
+//
+//  Thread exit - let another thread take over the ring
+//
+static void Release(void* r)
+{
+   __atomic_store_n(&((tracering_t*)r)->idle,1,__ATOMIC_RELEASE);
+}
+
+//
+//  Create the key that releases rings
+//
+static void MakeKey(void)
+{
+   if (pthread_key_create(&key,Release)) Fatal("Cannot create trace key\n");
+}
+
+//
+//  Ring for this thread (reused or created on first use)
+//
+static tracering_t* Ring(void)
+{
+   if (ring) return ring;
+   pthread_once(&once,MakeKey);
+   //  Take over the ring of a thread that exited
+   for (tracering_t* r=__atomic_load_n(&rings,__ATOMIC_ACQUIRE);r;r=r->next)
+   {
+      int idle=1;
+      if (__atomic_compare_exchange_n(&r->idle,&idle,0,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED))
+      {
+         ring = r;
+         pthread_setspecific(key,ring);
+         return ring;
+      }
+   }
+   //  New ring
+   ring = (tracering_t*)calloc(1,sizeof(tracering_t));
+   if (!ring) Fatal("Cannot allocate trace buffer\n");
+   ring->tid = __atomic_add_fetch(&nring,1,__ATOMIC_RELAXED);
+   //  Push onto the list of rings
+   ring->next = __atomic_load_n(&rings,__ATOMIC_RELAXED);
+   while (!__atomic_compare_exchange_n(&rings,&ring->next,ring,1,__ATOMIC_RELEASE,__ATOMIC_RELAXED));
+   pthread_setspecific(key,ring);
+   return ring;
+}
+
+//
+//  Add time to the total for a scope name
+//
+static void Sum(const char* name,long long dt)
+{
+   for (int k=0;k<MAXSTAT;k++)
+   {
+      const char* s = __atomic_load_n(&stat[k].name,__ATOMIC_ACQUIRE);
+      //  Claim a free slot (another thread may get there first)
+      if (!s)
+      {
+         if (__atomic_compare_exchange_n(&stat[k].name,&s,name,0,__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+         {
+            __atomic_add_fetch(&nstat,1,__ATOMIC_RELEASE);
+            s = name;
+         }
+      }
+      if (s==name || !strcmp(s,name))
+      {
+         __atomic_add_fetch(&stat[k].sum,dt,__ATOMIC_RELAXED);
+         return;
+      }
+   }
+}
+
+//
+//  Start a scope (use TraceScope)
+//
+tracescope_t TraceBegin(const char* name)
+{
+   tracescope_t s = {name,Nanos()};
+   return s;
+}
+
+//
+//  End a scope (called by the cleanup attribute)
+//
+void TraceEnd(tracescope_t* s)
+{
+   tracering_t* r = Ring();
+   unsigned int n = r->n;
+   traceevent_t* e = r->ev + (n&(RING-1));
+   e->name = s->name;
+   e->t0 = s->t0;
+   e->t1 = Nanos();
+   __atomic_store_n(&r->n,n+1,__ATOMIC_RELEASE);
+   Sum(e->name,e->t1-e->t0);
+}
+
+//
+//  Mark the end of a frame (call on the main thread)
+//
+void TraceFrame(void)
+{
+   mark[nmark++%MAXFRAME] = Nanos();
+   //  Publish averages
+   if (nmark%PERIOD==0)
+   {
+      int n = __atomic_load_n(&nstat,__ATOMIC_ACQUIRE);
+      for (int k=0;k<n;k++)
+         stat[k].ms = 1e-6*__atomic_exchange_n(&stat[k].sum,0,__ATOMIC_RELAXED)/PERIOD;
+   }
+}
+
+//
+//  Average time per frame for scope name k (returns 0 past the last name)
+//  Nested scopes are included in the time of the enclosing scope
+//
+int TraceStat(int k,const char** name,double* ms)
+{
+   if (k<0 || k>=__atomic_load_n(&nstat,__ATOMIC_ACQUIRE)) return 0;
+   //  Name may still be in the middle of being claimed
+   const char* s = __atomic_load_n(&stat[k].name,__ATOMIC_ACQUIRE);
+   if (!s) return 0;
+   *name = s;
+   *ms = stat[k].ms;
+   return 1;
+}
+
+//
+//  Write events from the last frames as Chrome trace_event JSON
+//
+void TraceDump(const char* file,int frames)
+{
+   FILE* f = fopen(file,"w");
+   if (!f) Fatal("Cannot open trace file %s\n",file);
+   //  Start of the first frame written
+   if (frames>MAXFRAME-1) frames = MAXFRAME-1;
+   unsigned int first = nmark>(unsigned int)frames ? nmark-frames : 0;
+   long long t0 = first ? mark[(first-1)%MAXFRAME] : 0;
+   int comma=0;
+   fprintf(f,"{\"traceEvents\":[\n");
+   //  Frames
+   for (unsigned int k=first;k<nmark;k++)
+   {
+      long long a = k ? mark[(k-1)%MAXFRAME] : mark[k%MAXFRAME];
+      long long b = mark[k%MAXFRAME];
+      fprintf(f,"%s{\"name\":\"frame %u\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+         comma++?",\n":"",k,a/1e3,(b-a)/1e3);
+   }
+   fprintf(f,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"frames\"}}",comma++?",\n":"");
+   //  Scopes recorded by each thread
+   for (tracering_t* r=__atomic_load_n(&rings,__ATOMIC_ACQUIRE);r;r=r->next)
+   {
+      unsigned int n = __atomic_load_n(&r->n,__ATOMIC_ACQUIRE);
+      fprintf(f,",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",r->tid,r->tid);
+      for (unsigned int k=n>RING?n-RING:0;k<n;k++)
+      {
+         traceevent_t* e = r->ev + (k&(RING-1));
+         if (e->t0<t0) continue;
+         fprintf(f,",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            e->name,r->tid,e->t0/1e3,(e->t1-e->t0)/1e3);
+      }
+   }
+   fprintf(f,"\n]}\n");
+   fclose(f);
+}
+
+//
+//  Write trace at exit
+//
+static void DumpAtExit(void)
+{
+   TraceDump(dump,dumpframes);
+}
+
+//
+//  Parse trace options
+//    -trace FILE        write a trace at exit
+//    -traceframes N     number of frames to write
+//
+void TraceInit(int argc,char* argv[])
+{
+   for (int k=1;k+1<argc;k++)
+   {
+      if (!strcmp(argv[k],"-trace"))
+         dump = argv[++k];
+      else if (!strcmp(argv[k],"-traceframes"))
+         dumpframes = atoi(argv[++k]);
+   }
+   if (dump) atexit(DumpAtExit);
+}
+#endif
@@ -10,21 +10,7 @@
  * - ESC:    quit
  */
 
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#ifdef USEGLEW
-#include <GL/glew.h>
-#endif
-//  OpenGL with prototypes for glext
-#define GL_GLEXT_PROTOTYPES
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-// Tell Xcode IDE to not gripe about OpenGL deprecation
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#else
-#include <GL/glut.h>
-#endif
+#include "../lighting/CSCIx229.h"
 
 // Globals
 int   th = 20;          // azimuth
@@ -33,25 +19,16 @@ double dim = 80.0;      // dimension of orthogonal box
 double s = 10.0;        // lorenz sigma
 double b = 2.6666;      // lorenz beta (~8/3) 
 double r = 28.0;        // lorenz rho   
-double x0 = 1.0, y0 = 1.0, z0 = 1.0; // coordinates
+double xi = 1.0, yi = 1.0, zi = 1.0; // initial coordinates (y0 is taken by math.h)
 double dt = 0.001;      // time step
 #define MAXPTS 50000    // maximum number of points
 static int    npts = 0;
 static double X[MAXPTS], Y[MAXPTS], Z[MAXPTS];
 
-// text helper
-#define LEN 1024
-static void Print(const char* fmt, ...)
-{
-    char buf[LEN]; va_list args;
-    va_start(args,fmt); vsnprintf(buf,LEN,fmt,args); va_end(args);
-    for (char* p = buf; *p; ++p) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*p);
-}
-
 // build Lorenz trajectory
 static void buildLorenz(void)
 {
-    double x = x0, y = y0, z = z0;
+    double x = xi, y = yi, z = zi;
     npts = 0;
     X[npts] = x; Y[npts] = y; Z[npts] = z; npts++;
 
@@ -103,6 +80,7 @@ static void display(void)
     // az/el hud
     glWindowPos2i(5,25);
     Print("[VIEW ANGLE] az = %d  el = %d", th,ph);
+    PrintFlush();
 
     glutSwapBuffers();
 }
@@ -126,7 +104,7 @@ static void key(unsigned char ch, int x, int y)
 
         // reset initial lorenz parameters
         case 'i':
-            s=10.0; r=28.0; b=2.6666; x0=y0=z0=1.0; buildLorenz(); break;
+            s=10.0; r=28.0; b=2.6666; xi=yi=zi=1.0; buildLorenz(); break;
         default: break;
     }
     glutPostRedisplay();
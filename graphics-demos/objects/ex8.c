@@ -10,22 +10,7 @@
  *  0          Reset view angle
  *  ESC        Exit
  */
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <math.h>
-#ifdef USEGLEW
-#include <GL/glew.h>
-#endif
-//  OpenGL with prototypes for glext
-#define GL_GLEXT_PROTOTYPES
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-// Tell Xcode IDE to not gripe about OpenGL deprecation
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#else
-#include <GL/glut.h>
-#endif
+#include "../lighting/CSCIx229.h"
 
 int th=0;          //  Azimuth of view angle
 int ph=0;          //  Elevation of view angle
@@ -34,50 +19,6 @@ int axes=1;        //  Display axes
 int mode=0;        //  What to display
 const char* text[] = {"Cuboids","Spheres","FlatPlane Outline","FlatPlane Fill","SolidPlane","Icosahedron DrawElements","Icosahedron DrawArrays","Icosahedron VBO","Scene"};
 
-//  Cosine and Sine in degrees
-#define Cos(x) (cos((x)*3.14159265/180)) //c in radians, must convert
-#define Sin(x) (sin((x)*3.14159265/180))
-
-/*
- *  Convenience routine to output raster text
- *  Use VARARGS to make this more flexible
- */
-#define LEN 8192  //  Maximum length of text string
-void Print(const char* format , ...)
-{
-   char    buf[LEN];
-   char*   ch=buf;
-   va_list args;
-   //  Turn the parameters into a character string
-   va_start(args,format);
-   vsnprintf(buf,LEN,format,args);
-   va_end(args);
-   //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
-}
-
-/*
- *  Check for OpenGL errors
- */
-void ErrCheck(const char* where)
-{
-   int err = glGetError();
-   if (err) fprintf(stderr,"ERROR: %s [%s]\n",gluErrorString(err),where);
-}
-
-/*
- *  Print message to stderr and exit
- */
-void Fatal(const char* format , ...)
-{
-   va_list args;
-   va_start(args,format);
-   vfprintf(stderr,format,args);
-   va_end(args);
-   exit(1);
-}
-
 /*
  *  Draw a cube
  *     at (x,y,z)
@@ -560,6 +501,7 @@ static void icosahedron3(float x,float y,float z,float s,float th)
       glBindBuffer(GL_ARRAY_BUFFER, vbo3);
       //  Copy icosahedron to VBO
       glBufferData(GL_ARRAY_BUFFER,sizeof(xyzrgb),xyzrgb,GL_STATIC_DRAW);
+      MemGL(MEM_BUFOBJ,vbo3,MEM_MESH,sizeof(xyzrgb));
    }
 
    //  Define vertexes
@@ -681,6 +623,8 @@ void display()
    glWindowPos2i(5,5);
    //  Print the text string
    Print("Angle=%d,%d    %s",th,ph,text[mode]);
+   //  Draw all text at once
+   PrintFlush();
    //  Render the scene
    ErrCheck("display");
    glFlush();
@@ -781,6 +725,8 @@ int main(int argc,char* argv[])
    //  Initialize GLEW
    if (glewInit()!=GLEW_OK) Fatal("Error initializing GLEW\n");
 #endif
+   //  Report OpenGL errors (--gl-debug for full checking)
+   ErrCheckInit(argc,argv);
    //  Tell GLUT to call "idle" when there is nothing else to do
    glutIdleFunc(idle);
    //  Tell GLUT to call "display" when the scene should be drawn
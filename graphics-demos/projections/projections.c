@@ -11,23 +11,15 @@
  *  PgDn/PgUp  Zoom in and out
  *  0          Reset view angle
  *  ESC        Exit
+ *
+ *  Options:
+ *  -record FILE  Record key presses as a camera path
+ *  -play FILE    Replay a camera path on a fixed timestep and print frame times
+ *  -dt SEC       Timestep for -play (default 1/60s)
+ *  -csv FILE     Write frame times to FILE
+ *  --gl-debug   Report OpenGL errors and warnings where they happen
  */
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <math.h>
-#ifdef USEGLEW
-#include <GL/glew.h>
-#endif
-//  OpenGL with prototypes for glext
-#define GL_GLEXT_PROTOTYPES
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-// Tell Xcode IDE to not gripe about OpenGL deprecation
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#else
-#include <GL/glut.h>
-#endif
+#include "../lighting/CSCIx229.h"
 
 int axes=0;       //  Display axes
 int mode=0;       //  Projection mode
@@ -41,55 +33,11 @@ double dim=10.0;   //  Size of world
 double ex=12.0, ey=1.0, ez=18.0;  // Eye position
 double yaw=45.0, pitch=30.0;      // Orientation (degrees)
 
-//  Macro for sin & cos in degrees
-#define Cos(th) cos(3.14159265/180*(th))
-#define Sin(th) sin(3.14159265/180*(th))
-
-/*
- *  Convenience routine to output raster text
- *  Use VARARGS to make this more flexible
- */
-#define LEN 8192  //  Maximum length of text string
-void Print(const char* format , ...)
-{
-   char    buf[LEN];
-   char*   ch=buf;
-   va_list args;
-   //  Turn the parameters into a character string
-   va_start(args,format);
-   vsnprintf(buf,LEN,format,args);
-   va_end(args);
-   //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
-}
-
-/*
- *  Check for OpenGL errors
- */
-void ErrCheck(const char* where)
-{
-   int err = glGetError();
-   if (err) fprintf(stderr,"ERROR: %s [%s]\n",gluErrorString(err),where);
-}
-
-/*
- *  Print message to stderr and exit
- */
-void Fatal(const char* format , ...)
-{
-   va_list args;
-   va_start(args,format);
-   vfprintf(stderr,format,args);
-   va_end(args);
-   exit(1);
-}
-
 /*
  *  Set projection
  *  Switches matrix mode to projection
  */
-static void Project()
+static void projection()
 {
    //  Tell OpenGL we want to manipulate the projection matrix
    glMatrixMode(GL_PROJECTION);
@@ -428,9 +376,12 @@ void display()
       Print("Yaw=%.0f Pitch=%.0f  Eye=(%.2f,%.2f,%.2f)  Dim=%.1f View=%s",
             yaw,pitch,ex,ey,ez,dim,viewStr);
    //  Render the scene and make it visible
+   PrintFlush();
    ErrCheck("display");
    glFlush();
    glutSwapBuffers();
+   //  Time frame and advance camera path
+   PathFrame();
 }
 
 /*
@@ -452,7 +403,8 @@ void special(int key,int x,int y)
    if (pitch >  89.0) pitch = 89.0;
    if (pitch < -89.0) pitch = -89.0;
 
-   Project();
+   projection();
+   PathKey(1,key);
    glutPostRedisplay();
 }
 
@@ -536,7 +488,8 @@ void key(unsigned char ch,int x,int y)
       axes = 1-axes;
    }
 
-   Project();
+   projection();
+   PathKey(0,ch);
    glutPostRedisplay();
 }
 
@@ -550,12 +503,12 @@ void reshape(int width,int height)
    //  Set the viewport to the entire window
    glViewport(0,0, width,height);
    //  Set projection
-   Project();
+   projection();
 }
 
 static void idle()
 {
-   double t = glutGet(GLUT_ELAPSED_TIME)/1000.0;
+   double t = PathTime();
    zh = (int)fmod(90.0*t,360.0);
    glutPostRedisplay();
 }
@@ -575,12 +528,24 @@ int main(int argc,char* argv[])
    //  Initialize GLEW
    if (glewInit()!=GLEW_OK) Fatal("Error initializing GLEW\n");
 #endif
+   //  Report OpenGL errors (--gl-debug for full checking)
+   ErrCheckInit(argc,argv);
    //  Set callbacks
    glutDisplayFunc(display);
    glutReshapeFunc(reshape);
    glutSpecialFunc(special);
    glutKeyboardFunc(key);
    glutIdleFunc(idle);
+   //  Camera path recording and playback
+   PathInt(&mode);
+   PathInt(&fov);
+   PathDouble(&ex);
+   PathDouble(&ey);
+   PathDouble(&ez);
+   PathDouble(&yaw);
+   PathDouble(&pitch);
+   PathDouble(&dim);
+   PathArgs(argc,argv,key,special);
    //  Pass control to GLUT so it can interact with the user
    glutMainLoop();
    return 0;
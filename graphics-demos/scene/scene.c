@@ -10,22 +10,7 @@
  *  0          Reset view angle
  *  ESC        Exit
  */
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdarg.h>
-#include <math.h>
-#ifdef USEGLEW
-#include <GL/glew.h>
-#endif
-//  OpenGL with prototypes for glext
-#define GL_GLEXT_PROTOTYPES
-#ifdef __APPLE__
-#include <GLUT/glut.h>
-// Tell Xcode IDE to not gripe about OpenGL deprecation
-#pragma clang diagnostic ignored "-Wdeprecated-declarations"
-#else
-#include <GL/glut.h>
-#endif
+#include "../lighting/CSCIx229.h"
 
 int th=20;          //  Azimuth of view angle
 int ph=30;          //  Elevation of view angle
@@ -34,50 +19,6 @@ int axes=1;        //  Display axes
 int mode=0;        //  What to display
 const char* text[] = {"Full Scene","Helicopter","Windmill"};
 
-//  Cosine and Sine in degrees
-#define Cos(x) (cos((x)*3.14159265/180)) //c in radians, must convert
-#define Sin(x) (sin((x)*3.14159265/180))
-
-/*
- *  Convenience routine to output raster text
- *  Use VARARGS to make this more flexible
- */
-#define LEN 8192  //  Maximum length of text string
-void Print(const char* format , ...)
-{
-   char    buf[LEN];
-   char*   ch=buf;
-   va_list args;
-   //  Turn the parameters into a character string
-   va_start(args,format);
-   vsnprintf(buf,LEN,format,args);
-   va_end(args);
-   //  Display the characters one at a time at the current raster position
-   while (*ch)
-      glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18,*ch++);
-}
-
-/*
- *  Check for OpenGL errors
- */
-void ErrCheck(const char* where)
-{
-   int err = glGetError();
-   if (err) fprintf(stderr,"ERROR: %s [%s]\n",gluErrorString(err),where);
-}
-
-/*
- *  Print message to stderr and exit
- */
-void Fatal(const char* format , ...)
-{
-   va_list args;
-   va_start(args,format);
-   vfprintf(stderr,format,args);
-   va_end(args);
-   exit(1);
-}
-
 // simple shapes with adjustable parameters, used to make other composites.
 /*
  *  Draw a cube
@@ -678,9 +619,11 @@ static void heliAssy(double x, double y, double z, double th)
     double winT = 0.02;
     double winYOffset = 0.2;
 
+    //  Place the helicopter with one matrix built on the CPU
+    float place[16];
+    Mat4Store(Mat4Rotate(Mat4Translate(Mat4Identity(),x,y,z),th,0,1,0),place);
     glPushMatrix();
-      glTranslated(x,y,z);
-      glRotated(th,0,1,0);
+      glMultMatrixf(place);
 
       cabinComposite(0, 0, 0, 0, wallT);
 
@@ -875,30 +818,61 @@ void display()
       // Scene with two helicopters and three windmills
       case 0:
       {
-         windmill(-10.0, 0.0, -8.0,
-                  5.0, 0.14, 0.08, 15,
-                  0.30, 0.06,
-                  4,
-                  2.2, 0.28, 0.08, 24);
-         windmill( 10.0, 0.0,  8.0,
-                  5.5, 0.16, 0.09, 15,
-                  0.32, 0.06,
-                  4,
-                  2.4, 0.28, 0.08, 24);
-         windmill( 0.0, 0.0, -14.0,
-                  6.0, 0.15, 0.09, 15,
-                  0.34, 0.06,
-                  4,
-                  2.6, 0.30, 0.08, 24);
+         //  Windmills (x,z,pole height,blade length), trees (x,z,height,radius) and rocks (x,z,scale)
+         static const double mill[3][4] = {{-10.0,-8.0,5.0,2.2},{10.0,8.0,5.5,2.4},{0.0,-14.0,6.0,2.6}};
+         static const double pine[3][4] = {{-12.0,-6.0,3.5,2.0},{12.0,6.0,3.2,1.8},{0.0,10.0,2.8,1.6}};
+         static const double pebble[3][3] = {{-5.0,-3.0,1.2},{5.0,3.5,1.0},{1.0,-8.0,0.8}};
+         //  Bounding boxes in the same order
+         float xmin[9],ymin[9],zmin[9],xmax[9],ymax[9],zmax[9];
+         unsigned char vis[9];
+         int n=0;
+         for (int k=0;k<3;k++,n++)
+         {
+            const double* m = mill[k];
+            xmin[n] = m[0]-0.5*m[3]; ymin[n] = 0.0;             zmin[n] = m[1]-0.5;
+            xmax[n] = m[0]+0.5*m[3]; ymax[n] = m[2]+0.5*m[3];  zmax[n] = m[1]+0.5;
+         }
+         for (int k=0;k<3;k++,n++)
+         {
+            const double* t = pine[k];
+            xmin[n] = t[0]-t[3]; ymin[n] = -0.2*t[2]; zmin[n] = t[1]-t[3];
+            xmax[n] = t[0]+t[3]; ymax[n] =  1.1*t[2]; zmax[n] = t[1]+t[3];
+         }
+         for (int k=0;k<3;k++,n++)
+         {
+            const double* r = pebble[k];
+            xmin[n] = r[0]-1.25*r[2]; ymin[n] = -0.6*r[2]; zmin[n] = r[1]-1.25*r[2];
+            xmax[n] = r[0]+1.25*r[2]; ymax[n] =  0.7*r[2]; zmax[n] = r[1]+1.25*r[2];
+         }
+         //  Skip objects outside the view
+         frustum_t f = FrustumGL();
+         BoxesVisible(&f,n,xmin,ymin,zmin,xmax,ymax,zmax,vis);
+
+         if (vis[0])
+            windmill(-10.0, 0.0, -8.0,
+                     5.0, 0.14, 0.08, 15,
+                     0.30, 0.06,
+                     4,
+                     2.2, 0.28, 0.08, 24);
+         if (vis[1])
+            windmill( 10.0, 0.0,  8.0,
+                     5.5, 0.16, 0.09, 15,
+                     0.32, 0.06,
+                     4,
+                     2.4, 0.28, 0.08, 24);
+         if (vis[2])
+            windmill( 0.0, 0.0, -14.0,
+                     6.0, 0.15, 0.09, 15,
+                     0.34, 0.06,
+                     4,
+                     2.6, 0.30, 0.08, 24);
 
          // Trees
-         tree(-12.0, 0.0, -6.0, 3.5, 2.0);
-         tree( 12.0, 0.0,  6.0, 3.2, 1.8);
-         tree(  0.0, 0.0, 10.0, 2.8, 1.6);
+         for (int k=0;k<3;k++)
+            if (vis[3+k]) tree(pine[k][0],0.0,pine[k][1],pine[k][2],pine[k][3]);
          // Rocks
-         rock(-5.0, 0.0, -3.0, 1.2);
-         rock( 5.0, 0.0,  3.5, 1.0);
-         rock( 1.0, 0.0, -8.0, 0.8);
+         for (int k=0;k<3;k++)
+            if (vis[6+k]) rock(pebble[k][0],0.0,pebble[k][1],pebble[k][2]);
 
          // Helicopters circling around Y-axis
          double R1 = 5.0;
@@ -909,22 +883,28 @@ void display()
          double x1 = R1*Cos(a1);
          double z1 = R1*Sin(a1);
          double yaw1 = 90.0 - a1;
-         glPushMatrix();
-           glTranslated(x1, 1.6, z1);
-           glRotated(yaw1,0,1,0);
-           glScaled(0.6,0.6,0.6);
-           heliAssy(0,0,0,0);
-         glPopMatrix();
+         if (SphereVisible(&f,x1,1.6,z1,5.0))
+         {
+            float place[16];
+            Mat4Store(Mat4Scale(Mat4Rotate(Mat4Translate(Mat4Identity(),x1,1.6,z1),yaw1,0,1,0),0.6,0.6,0.6),place);
+            glPushMatrix();
+              glMultMatrixf(place);
+              heliAssy(0,0,0,0);
+            glPopMatrix();
+         }
 
          double x2 = R2*Cos(a2);
          double z2 = R2*Sin(a2);
          double yaw2 = 90.0 - a2;
-         glPushMatrix();
-           glTranslated(x2, 2.0, z2);
-           glRotated(yaw2,0,1,0);
-           glScaled(0.6,0.6,0.6);
-           heliAssy(0,0,0,0);
-         glPopMatrix();
+         if (SphereVisible(&f,x2,2.0,z2,5.0))
+         {
+            float place[16];
+            Mat4Store(Mat4Scale(Mat4Rotate(Mat4Translate(Mat4Identity(),x2,2.0,z2),yaw2,0,1,0),0.6,0.6,0.6),place);
+            glPushMatrix();
+              glMultMatrixf(place);
+              heliAssy(0,0,0,0);
+            glPopMatrix();
+         }
          break;
       }
       case 1:
@@ -965,6 +945,8 @@ void display()
    glWindowPos2i(5,5);
    //  Print the text string
   //  Print("Angle=%d,%d    %s",th,ph,text[mode]);
+   //  Draw all text at once
+   PrintFlush();
    //  Render the scene
    ErrCheck("display");
    glFlush();
@@ -1063,6 +1045,8 @@ int main(int argc,char* argv[])
    //  Initialize GLEW
    if (glewInit()!=GLEW_OK) Fatal("Error initializing GLEW\n");
 #endif
+   //  Report OpenGL errors (--gl-debug for full checking)
+   ErrCheckInit(argc,argv);
    //  Tell GLUT to call "idle" when there is nothing else to do
    glutIdleFunc(idle);
    //  Tell GLUT to call "display" when the scene should be drawn